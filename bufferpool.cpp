@@ -0,0 +1,38 @@
+#include "bufferpool.h"
+
+BufferPool::BufferPool(size_t bufferSize, size_t preallocate)
+    : m_bufferSize(bufferSize), m_allocated(0)
+{
+    m_free.reserve(preallocate);
+    for (size_t i = 0; i < preallocate; ++i)
+    {
+        m_free.push_back(new char[m_bufferSize]);
+        ++m_allocated;
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    // buffers still handed out are owned by the caller
+    for (size_t i = 0; i < m_free.size(); ++i)
+    {
+        delete[] m_free[i];
+    }
+}
+
+char* BufferPool::get()
+{
+    if (m_free.empty())
+    {
+        ++m_allocated;
+        return new char[m_bufferSize];
+    }
+    char* buffer = m_free.back();
+    m_free.pop_back();
+    return buffer;
+}
+
+void BufferPool::put(char* buffer)
+{
+    m_free.push_back(buffer);
+}
@@ -0,0 +1,29 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <vector>
+#include <stddef.h>
+
+// Fixed-size receive buffers recycled through a free list, so the hot path
+// neither allocates nor copies. Not thread-safe.
+class BufferPool
+{
+public:
+    BufferPool(size_t bufferSize, size_t preallocate);
+    ~BufferPool();
+
+    size_t bufferSize() const { return m_bufferSize; }
+    size_t allocated() const { return m_allocated; }
+
+    char* get();
+    void put(char* buffer);
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    size_t m_bufferSize;
+    size_t m_allocated;
+    std::vector<char*> m_free;
+};
+
+#endif // BUFFERPOOL_H
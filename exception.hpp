@@ -6,6 +6,16 @@
 typedef boost::tuple<boost::errinfo_api_function,boost::errinfo_errno> clib_failure;
 typedef boost::error_info<struct tag_sa_family, sa_family_t> sa_family_info;
 typedef boost::error_info<struct tag_recv_error_info, const char*> recv_error_info;
+typedef boost::error_info<struct tag_scheduler_info, std::string> scheduler_info;
+typedef boost::error_info<struct tag_timestamp_mode_info, std::string> timestamp_mode_info;
+typedef boost::error_info<struct tag_busy_poll_mode_info, std::string> busy_poll_mode_info;
+typedef boost::error_info<struct tag_sink_spec_info, std::string> sink_spec_info;
+typedef boost::error_info<struct tag_route_rule_info, std::string> route_rule_info;
+typedef boost::error_info<struct tag_shm_info, std::string> shm_info;
+typedef boost::error_info<struct tag_scenario_info, std::string> scenario_info;
+typedef boost::error_info<struct tag_stream_info, int> stream_info;
+typedef boost::error_info<struct tag_sysctl_info, std::string> sysctl_info;
+typedef boost::error_info<struct tag_tuning_info, std::string> tuning_info;
 
 struct SctpCatError : virtual boost::exception, virtual std::exception {};
 struct SctpReceiveError : virtual SctpCatError {};
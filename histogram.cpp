@@ -0,0 +1,87 @@
+#include "histogram.h"
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+LatencyHistogram::LatencyHistogram()
+    : m_buckets(64 * s_subBuckets, 0)
+{
+    clear();
+}
+
+void LatencyHistogram::clear()
+{
+    std::fill(m_buckets.begin(), m_buckets.end(), 0);
+    m_count = 0;
+    m_sum = 0;
+    m_min = std::numeric_limits<uint64_t>::max();
+    m_max = 0;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t value)
+{
+    if (value < s_subBuckets)
+    {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    uint64_t sub = (value >> (msb - s_subBits)) & (s_subBuckets - 1);
+    return (msb - s_subBits + 1) * s_subBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket)
+{
+    if (bucket < size_t(s_subBuckets))
+    {
+        return bucket;
+    }
+    int msb = bucket / s_subBuckets + s_subBits - 1;
+    uint64_t sub = bucket % s_subBuckets;
+    uint64_t base = (uint64_t(s_subBuckets) | sub) << (msb - s_subBits);
+    return base + (uint64_t(1) << (msb - s_subBits)) - 1;
+}
+
+void LatencyHistogram::add(uint64_t value)
+{
+    ++m_buckets[bucketOf(value)];
+    ++m_count;
+    m_sum += value;
+    if (value < m_min) m_min = value;
+    if (value > m_max) m_max = value;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = uint64_t(p / 100.0 * m_count);
+    if (rank >= m_count) rank = m_count - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_buckets.size(); ++i)
+    {
+        seen += m_buckets[i];
+        if (seen > rank)
+        {
+            uint64_t bound = bucketUpperBound(i);
+            return bound < m_max ? bound : m_max;
+        }
+    }
+    return m_max;
+}
+
+void LatencyHistogram::print(std::ostream& os, const std::string& label) const
+{
+    std::ios::fmtflags f = os.flags();
+    os << std::fixed << std::setprecision(1);
+    os << label << ": n=" << m_count
+       << " min=" << min() / 1000.0
+       << " avg=" << mean() / 1000.0
+       << " p50=" << percentile(50) / 1000.0
+       << " p90=" << percentile(90) / 1000.0
+       << " p99=" << percentile(99) / 1000.0
+       << " p99.9=" << percentile(99.9) / 1000.0
+       << " max=" << max() / 1000.0 << " us\n";
+    os.flags(f);
+}
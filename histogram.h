@@ -0,0 +1,40 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Log-linear latency histogram: every power of two is split into
+// s_subBuckets linear buckets, so relative error stays below 1/s_subBuckets.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(uint64_t value);
+    void clear();
+
+    uint64_t count() const { return m_count; }
+    uint64_t min() const { return m_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    uint64_t mean() const { return m_count ? m_sum / m_count : 0; }
+    uint64_t percentile(double p) const;
+
+    // One-line summary, values printed in microseconds (input is nanoseconds)
+    void print(std::ostream& os, const std::string& label) const;
+private:
+    static const int s_subBits = 4;
+    static const int s_subBuckets = 1 << s_subBits;
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketUpperBound(size_t bucket);
+
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,146 @@
+#include "holbench.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <boost/algorithm/string.hpp>
+
+#include "exception.hpp"
+#include "probe.h"
+#include "sctpcat.h"
+#include "util.hpp"
+
+HolBench::HolBench(SctpCat& sc, const boost::program_options::variables_map& options)
+    : m_sc(sc), m_fd(-1), m_assoc_id(0), m_scheduler(0), m_running(false), m_started(false)
+{
+    std::vector<std::string> names;
+    boost::split(names, options["hol-schedulers"].as<std::string>(), boost::is_any_of(","));
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        m_schedulers.push_back(parseStreamScheduler(names[i]));
+    }
+    m_duration = options["hol-duration"].as<int>();
+    m_bulkBytes = options["bulk-bytes"].as<int>();
+    int bulkStream = options["bulk-stream"].as<int>();
+    int probeStream = options["probe-stream"].as<int>();
+    if (bulkStream < 0 || bulkStream > 0xffff)
+    {
+        SCTPCAT_THROW(SctpCatError()) << stream_info(bulkStream);
+    }
+    if (probeStream < 0 || probeStream > 0xffff)
+    {
+        SCTPCAT_THROW(SctpCatError()) << stream_info(probeStream);
+    }
+    m_bulkStream = bulkStream;
+    m_probeBytes = std::max<int>(options["probe-bytes"].as<int>(), sizeof(ProbeHeader));
+    m_probeStream = probeStream;
+    m_probeInterval = options["probe-interval"].as<int>();
+    m_tuning = ThreadTuning(options["tx-cpus"].as<std::string>(), options["rt-priority"].as<int>());
+}
+
+void HolBench::start(int fd, sctp_assoc_t assoc_id)
+{
+    if (m_started)
+    {
+        return;
+    }
+    m_started = true;
+    m_fd = fd;
+    m_assoc_id = assoc_id;
+    sizeSendBuffer();
+    m_controlThread = boost::thread(boost::bind(&HolBench::control, this));
+}
+
+// Bulk and probes share the socket send buffer. A bulk message that does not
+// leave room for several more keeps it full, so probes would wait for buffer
+// space before the stream scheduler ever sees them. Grow the buffer to four
+// bulk messages where the system allows it, otherwise shrink the messages.
+void HolBench::sizeSendBuffer()
+{
+    int sndbuf = 0;
+    socklen_t len = sizeof(sndbuf);
+    if (m_bulkBytes > 0)
+    {
+        int wanted = m_bulkBytes * 4;
+        // failure only means net.core.wmem_max applies, checked below
+        setsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &wanted, socklen_t(sizeof(wanted)));
+    }
+    if (getsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("getsockopt", errno);
+    }
+    if (m_bulkBytes <= 0 || m_bulkBytes > sndbuf / 4)
+    {
+        if (m_bulkBytes > 0)
+        {
+            std::cerr << "hol-bench: send buffer limited to " << sndbuf << " bytes (net.core.wmem_max), ";
+        }
+        m_bulkBytes = sndbuf / 4;
+    }
+    std::cerr << "hol-bench: bulk messages of " << m_bulkBytes << " bytes, send buffer " << sndbuf << " bytes\n";
+}
+
+void HolBench::applyScheduler(int scheduler)
+{
+    m_sc.setStreamScheduler(m_assoc_id, scheduler);
+    // prio: lower value wins, so the probe stream goes first
+    if (scheduler == parseStreamScheduler("prio"))
+    {
+        m_sc.setStreamSchedulerValue(m_assoc_id, m_probeStream, 0);
+        m_sc.setStreamSchedulerValue(m_assoc_id, m_bulkStream, 1);
+    }
+    m_scheduler = scheduler;
+}
+
+void HolBench::control()
+{
+    applyScheduler(m_schedulers.front());
+    m_running = true;
+    m_bulkThread = boost::thread(boost::bind(&HolBench::bulkLoop, this));
+    m_probeThread = boost::thread(boost::bind(&HolBench::probeLoop, this));
+    for (size_t i = 0; i < m_schedulers.size(); ++i)
+    {
+        if (i > 0)
+        {
+            applyScheduler(m_schedulers[i]);
+        }
+        boost::this_thread::sleep(boost::posix_time::seconds(m_duration));
+    }
+    m_running = false;
+    m_probeThread.join();
+    m_bulkThread.join();
+    std::cerr << timestamp() << "hol-bench done\n";
+    // the receiver reports the last scheduler when the association ends
+    sctp_sndrcvinfo sinfo;
+    memset(&sinfo, 0, sizeof(sinfo));
+    sinfo.sinfo_assoc_id = m_assoc_id;
+    sinfo.sinfo_flags = SCTP_EOF;
+    if (sctp_send(m_fd, NULL, 0, &sinfo, MSG_NOSIGNAL) == -1 && shutdown(m_fd, SHUT_WR) == -1)
+    {
+        std::cerr << timestamp() << "hol-bench: shutdown: " << strerror(errno) << "\n";
+    }
+    m_sc.stop();
+}
+
+void HolBench::bulkLoop()
+{
+    m_tuning.apply(0);
+    std::vector<char> buf(m_bulkBytes, 'B');
+    while (m_running)
+    {
+        m_sc.send(&buf[0], buf.size(), m_bulkStream, 0);
+    }
+}
+
+void HolBench::probeLoop()
+{
+    m_tuning.apply(1);
+    std::vector<char> buf(m_probeBytes, 'P');
+    uint32_t seq = 0;
+    while (m_running)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(m_probeInterval));
+        writeProbe(&buf[0], buf.size(), seq++, m_scheduler);
+        m_sc.send(&buf[0], buf.size(), m_probeStream, 0);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef HOLBENCH_H
+#define HOLBENCH_H
+
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <netinet/sctp.h>
+
+#include "lowlatency.hpp"
+
+class SctpCat;
+
+// Head-of-line blocking benchmark: one thread keeps a bulk stream busy with
+// large messages while another sends small timestamped probes on a second
+// stream. The run cycles through the configured stream schedulers; the probe
+// tag carries the active scheduler so the receiver reports latency per
+// scheduler.
+class HolBench
+{
+public:
+    HolBench(SctpCat& sc, const boost::program_options::variables_map& options);
+
+    void start(int fd, sctp_assoc_t assoc_id);
+private:
+    void sizeSendBuffer();
+    void control();
+    void bulkLoop();
+    void probeLoop();
+    void applyScheduler(int scheduler);
+
+    SctpCat& m_sc;
+    int m_fd;
+    sctp_assoc_t m_assoc_id;
+    std::vector<int> m_schedulers;
+    int m_duration;
+    int m_bulkBytes;
+    uint16_t m_bulkStream;
+    int m_probeBytes;
+    uint16_t m_probeStream;
+    int m_probeInterval;
+    ThreadTuning m_tuning;
+    boost::atomic<int> m_scheduler;
+    boost::atomic<bool> m_running;
+    bool m_started;
+    boost::thread m_controlThread;
+    boost::thread m_bulkThread;
+    boost::thread m_probeThread;
+};
+
+#endif // HOLBENCH_H
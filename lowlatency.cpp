@@ -0,0 +1,97 @@
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <boost/algorithm/string.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "exception.hpp"
+#include "lowlatency.hpp"
+
+void pinCurrentThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rv = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rv != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("pthread_setaffinity_np", rv);
+    }
+}
+
+void setRealtimePriority(int priority)
+{
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int rv = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rv != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("pthread_setschedparam", rv);
+    }
+}
+
+void lockAllMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("mlockall", errno);
+    }
+    std::cerr << "Memory locked\n";
+}
+
+ThreadTuning::ThreadTuning()
+    : rtPriority(0)
+{
+}
+
+ThreadTuning::ThreadTuning(const std::string& cpuList, int rtPriority)
+    : rtPriority(rtPriority)
+{
+    std::vector<std::string> items;
+    boost::split(items, cpuList, boost::is_any_of(","), boost::token_compress_on);
+    long cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (!items[i].empty())
+        {
+            int cpu = boost::lexical_cast<int>(items[i]);
+            if (cpu < 0 || cpu >= cpuCount || cpu >= CPU_SETSIZE)
+            {
+                SCTPCAT_THROW(SctpCatError()) << tuning_info("no cpu " + items[i]);
+            }
+            cpus.push_back(cpu);
+        }
+    }
+    if (rtPriority < 0 || rtPriority > sched_get_priority_max(SCHED_FIFO))
+    {
+        SCTPCAT_THROW(SctpCatError())
+            << tuning_info("rt priority " + boost::lexical_cast<std::string>(rtPriority) + " out of range");
+    }
+}
+
+void ThreadTuning::apply(size_t index) const
+{
+    try
+    {
+        if (!cpus.empty())
+        {
+            int cpu = cpus[index % cpus.size()];
+            pinCurrentThread(cpu);
+            std::cerr << "Thread pinned to cpu " << cpu << "\n";
+        }
+        if (rtPriority > 0)
+        {
+            setRealtimePriority(rtPriority);
+        }
+    }
+    catch (boost::exception& e)
+    {
+        std::cerr << "Thread tuning failed, running untuned:\n" << boost::diagnostic_information(e);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef SCTPCAT_LOWLATENCY_HPP
+#define SCTPCAT_LOWLATENCY_HPP
+
+#include <string>
+#include <vector>
+
+void pinCurrentThread(int cpu);
+void setRealtimePriority(int priority);
+void lockAllMemory();
+
+// CPU placement and scheduling for a group of threads (the receive loop or
+// the senders). Thread i of the group runs on cpus[i % cpus.size()]. The CPU
+// list and priority are checked on construction; apply() runs inside the
+// threads themselves, so it only logs what the system refuses (a missing
+// CAP_SYS_NICE, say) and leaves the thread untuned.
+struct ThreadTuning
+{
+    ThreadTuning();
+    ThreadTuning(const std::string& cpuList, int rtPriority);
+
+    void apply(size_t index) const;
+
+    std::vector<int> cpus;
+    int rtPriority;
+};
+
+#endif // SCTPCAT_LOWLATENCY_HPP
@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <boost/make_shared.hpp>
+
+#include "exception.hpp"
+#include "outputsink.h"
+
+OutputSink::OutputSink(const std::string& spec)
+    : m_spec(spec), m_drops(0)
+{
+}
+
+void OutputSink::write(uint64_t source, const char* buf, size_t len, bool eor)
+{
+    if (eor && m_partials.empty())
+    {
+        writeMessage(buf, len);
+        return;
+    }
+    std::vector<char>& partial = m_partials[source];
+    partial.insert(partial.end(), buf, buf + len);
+    if (eor)
+    {
+        writeMessage(partial.empty() ? NULL : &partial[0], partial.size());
+        m_partials.erase(source);
+    }
+}
+
+boost::shared_ptr<OutputSink> OutputSink::create(const std::string& spec)
+{
+    if (spec == "discard")
+    {
+        return boost::make_shared<DiscardSink>();
+    }
+    std::string::size_type colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    if (kind == "file")
+    {
+        int fd = open(arg.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("open", errno) << sink_spec_info(spec);
+        }
+        return boost::make_shared<FdSink>(spec, fd);
+    }
+    if (kind == "pipe")
+    {
+        FILE* pipe = popen(arg.c_str(), "w");
+        if (pipe == NULL)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("popen", errno) << sink_spec_info(spec);
+        }
+        return boost::make_shared<PipeSink>(spec, pipe);
+    }
+    if (kind == "unix")
+    {
+        return boost::make_shared<UnixDgramSink>(spec, arg);
+    }
+    SCTPCAT_THROW(SctpCatError()) << sink_spec_info(spec);
+}
+
+FdSink::FdSink(const std::string& spec, int fd)
+    : OutputSink(spec), m_fd(fd)
+{
+    m_buffer.reserve(s_flushThreshold * 2);
+}
+
+FdSink::~FdSink()
+{
+    flush();
+    if (m_fd != -1)
+    {
+        close(m_fd);
+    }
+}
+
+void FdSink::writeMessage(const char* buf, size_t len)
+{
+    m_buffer.insert(m_buffer.end(), buf, buf + len);
+    m_ends.push_back(m_buffer.size());
+    if (m_buffer.size() >= s_flushThreshold)
+    {
+        flush();
+    }
+}
+
+void FdSink::flush()
+{
+    size_t done = 0;
+    while (done < m_buffer.size())
+    {
+        ssize_t rv = ::write(m_fd, &m_buffer[done], m_buffer.size() - done);
+        if (rv == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // everything not written completely is lost
+            m_drops += m_ends.end() - std::upper_bound(m_ends.begin(), m_ends.end(), done);
+            break;
+        }
+        done += rv;
+    }
+    m_buffer.clear();
+    m_ends.clear();
+}
+
+PipeSink::PipeSink(const std::string& spec, FILE* pipe)
+    : FdSink(spec, fileno(pipe)), m_pipe(pipe)
+{
+    signal(SIGPIPE, SIG_IGN);
+}
+
+PipeSink::~PipeSink()
+{
+    flush();
+    pclose(m_pipe);
+    // pclose() has closed the descriptor already
+    m_fd = -1;
+}
+
+UnixDgramSink::UnixDgramSink(const std::string& spec, const std::string& path)
+    : OutputSink(spec), m_pending(s_maxBatch), m_pendingCount(0)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        SCTPCAT_THROW(SctpCatError()) << sink_spec_info(spec);
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    m_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("socket", errno);
+    }
+    if (connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("connect", errno) << sink_spec_info(spec);
+    }
+}
+
+UnixDgramSink::~UnixDgramSink()
+{
+    flush();
+    close(m_fd);
+}
+
+void UnixDgramSink::writeMessage(const char* buf, size_t len)
+{
+    m_pending[m_pendingCount++].assign(buf, buf + len);
+    if (m_pendingCount == s_maxBatch)
+    {
+        flush();
+    }
+}
+
+void UnixDgramSink::flush()
+{
+    if (m_pendingCount == 0)
+    {
+        return;
+    }
+    iovec iov[s_maxBatch];
+    mmsghdr msgs[s_maxBatch];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < m_pendingCount; ++i)
+    {
+        iov[i].iov_base = m_pending[i].empty() ? NULL : &m_pending[i][0];
+        iov[i].iov_len = m_pending[i].size();
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t sent = 0;
+    while (sent < m_pendingCount)
+    {
+        int rv = sendmmsg(m_fd, msgs + sent, m_pendingCount - sent, 0);
+        if (rv == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // EAGAIN: the consumer is not keeping up; drop the rest of the batch
+            m_drops += m_pendingCount - sent;
+            break;
+        }
+        sent += rv;
+    }
+    for (size_t i = 0; i < m_pendingCount; ++i)
+    {
+        m_pending[i].clear();
+    }
+    m_pendingCount = 0;
+}
+
+DiscardSink::DiscardSink()
+    : OutputSink("discard")
+{
+}
@@ -0,0 +1,97 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+// Local destination for routed messages. Writes are buffered and pushed out
+// by flush(), which the receive loop calls once per drained batch.
+class OutputSink
+{
+public:
+    OutputSink(const std::string& spec);
+    virtual ~OutputSink() {}
+
+    // eor marks the last piece of a user message. With interleaving, pieces
+    // of messages from different sources (association and stream) arrive
+    // mixed; they are reassembled per source so sinks only see whole messages.
+    void write(uint64_t source, const char* buf, size_t len, bool eor);
+    virtual void flush() = 0;
+
+    const std::string& spec() const { return m_spec; }
+    uint64_t drops() const { return m_drops; }
+
+    // file:PATH, pipe:COMMAND, unix:PATH or discard
+    static boost::shared_ptr<OutputSink> create(const std::string& spec);
+protected:
+    virtual void writeMessage(const char* buf, size_t len) = 0;
+
+    std::string m_spec;
+    uint64_t m_drops;
+private:
+    boost::unordered_map<uint64_t, std::vector<char> > m_partials;
+};
+
+// Byte stream to a file, FIFO or command; message boundaries are not kept
+class FdSink : public OutputSink
+{
+public:
+    FdSink(const std::string& spec, int fd);
+    ~FdSink();
+
+    void flush();
+protected:
+    void writeMessage(const char* buf, size_t len);
+
+    static const size_t s_flushThreshold = 64 * 1024;
+    int m_fd;
+    std::vector<char> m_buffer;
+    // end offset of every message in m_buffer, so a failed write counts the
+    // messages it loses
+    std::vector<size_t> m_ends;
+};
+
+// The command's stdin; SIGPIPE is ignored once one exists, so a command that
+// exits turns the following writes into drops instead of killing sctpcat
+class PipeSink : public FdSink
+{
+public:
+    PipeSink(const std::string& spec, FILE* pipe);
+    ~PipeSink();
+private:
+    FILE* m_pipe;
+};
+
+// One datagram per user message on a unix datagram socket. A consumer that
+// falls behind loses messages (counted as drops) instead of stalling SCTP.
+class UnixDgramSink : public OutputSink
+{
+public:
+    UnixDgramSink(const std::string& spec, const std::string& path);
+    ~UnixDgramSink();
+
+    void flush();
+protected:
+    void writeMessage(const char* buf, size_t len);
+private:
+    static const size_t s_maxBatch = 64;
+    int m_fd;
+    std::vector< std::vector<char> > m_pending;
+    size_t m_pendingCount;
+};
+
+class DiscardSink : public OutputSink
+{
+public:
+    DiscardSink();
+
+    void flush() {}
+protected:
+    void writeMessage(const char*, size_t) {}
+};
+
+#endif // OUTPUTSINK_H
@@ -1,8 +1,10 @@
 #include "pingthread.h"
 #include <boost/thread.hpp>
 
-PingThread::PingThread(ISctpSink& sink, int bytes, int interval)
-    : m_sink(sink), m_bytes(bytes), m_interval(interval)
+#include "probe.h"
+
+PingThread::PingThread(ISctpSink& sink, int bytes, int interval, const ThreadTuning& tuning)
+    : m_sink(sink), m_bytes(bytes), m_interval(interval), m_tuning(tuning)
 {
 }
 
@@ -13,14 +15,21 @@ void PingThread::start()
 
 void PingThread::loop()
 {
+    m_tuning.apply(0);
     std::vector<char> buf(m_bytes);
     for (int i = 0; i < m_bytes; ++i)
     {
         buf[i] = 'A' + (i % ('Z' - 'A'));
     }
-    for (;;)
+    // a probe header lets a receiver with --timestamps measure one-way latency
+    bool probe = m_bytes >= int(sizeof(ProbeHeader));
+    for (uint32_t seq = 0; ; ++seq)
     {
         boost::this_thread::sleep(boost::posix_time::milliseconds(m_interval));
+        if (probe)
+        {
+            writeProbe(&buf[0], buf.size(), seq, s_probeTagPing);
+        }
         m_sink.send(&buf[0], m_bytes);
     }
 }
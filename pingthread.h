@@ -2,12 +2,13 @@
 #define PINGTHREAD_H
 
 #include "isctpsink.h"
+#include "lowlatency.hpp"
 #include <boost/thread.hpp>
 
 class PingThread
 {
 public:
-    PingThread(ISctpSink& sink, int bytes, int interval);
+    PingThread(ISctpSink& sink, int bytes, int interval, const ThreadTuning& tuning = ThreadTuning());
 
     void start();
 private:
@@ -16,6 +17,7 @@ private:
     ISctpSink& m_sink;
     int m_bytes;
     int m_interval;
+    ThreadTuning m_tuning;
     boost::thread m_thread;
 };
 
@@ -0,0 +1,73 @@
+#include "probe.h"
+#include <cstring>
+#include <iostream>
+
+#include "util.hpp"
+
+void writeProbe(char* buf, size_t len, uint32_t seq, uint32_t tag)
+{
+    ProbeHeader probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.magic = s_probeMagic;
+    probe.seq = seq;
+    probe.tag = tag;
+    probe.sentNs = realtimeNs();
+    if (len >= sizeof(probe))
+    {
+        memcpy(buf, &probe, sizeof(probe));
+    }
+}
+
+bool readProbe(const char* buf, size_t len, ProbeHeader& probe)
+{
+    if (len < sizeof(probe))
+    {
+        return false;
+    }
+    memcpy(&probe, buf, sizeof(probe));
+    return probe.magic == s_probeMagic;
+}
+
+ProbeCollector::ProbeCollector()
+    : m_lastTag(0), m_probes(0)
+{
+}
+
+void ProbeCollector::onData(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags,
+                            uint64_t arrivalNs)
+{
+    uint64_t now = arrivalNs ? arrivalNs : realtimeNs();
+    StreamKey key(sinfo.sinfo_assoc_id, sinfo.sinfo_stream);
+    std::map<StreamKey, bool>::iterator it = m_atBoundary.insert(std::make_pair(key, true)).first;
+    bool messageStart = it->second;
+    it->second = (flags & MSG_EOR) != 0;
+
+    ProbeHeader probe;
+    if (!messageStart || !readProbe(buf, len, probe))
+    {
+        return;
+    }
+    if (m_probes > 0 && probe.tag != m_lastTag)
+    {
+        report(std::cerr);
+    }
+    m_lastTag = probe.tag;
+    ++m_probes;
+    m_latency[probe.tag].add(now > probe.sentNs ? now - probe.sentNs : 0);
+}
+
+void ProbeCollector::report(std::ostream& os)
+{
+    std::map<uint32_t, LatencyHistogram>::const_iterator it = m_latency.find(m_lastTag);
+    if (it == m_latency.end() || it->second.count() == 0)
+    {
+        return;
+    }
+    os << timestamp();
+    if (it->first == s_probeTagPing)
+    {
+        it->second.print(os, "probe latency, ping");
+        return;
+    }
+    it->second.print(os, std::string("probe latency, scheduler ") + streamSchedulerName(it->first));
+}
@@ -0,0 +1,51 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <iosfwd>
+#include <map>
+#include <stdint.h>
+#include <netinet/sctp.h>
+
+#include "histogram.h"
+
+// Small latency probe carried at the start of a user message. The send time
+// is taken from CLOCK_REALTIME, so one-way latency is only meaningful when
+// both ends share a clock (loopback, or PTP-synchronized hosts).
+struct ProbeHeader
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t sentNs;
+};
+
+static const uint32_t s_probeMagic = 0x53435042; // "SCPB"
+// tag of ping probes, which run without a stream scheduler
+static const uint32_t s_probeTagPing = 0xffffffff;
+
+// Fills the start of buf with a probe header; len must be >= sizeof(ProbeHeader)
+void writeProbe(char* buf, size_t len, uint32_t seq, uint32_t tag);
+bool readProbe(const char* buf, size_t len, ProbeHeader& probe);
+
+// Receiver side: recognizes probes at message boundaries and collects
+// one-way latency per tag (the sender uses the stream scheduler as tag).
+// With kernel receive timestamps the latency ends at socket arrival, so it
+// excludes time the message spent queued behind sctpcat itself.
+class ProbeCollector
+{
+public:
+    ProbeCollector();
+
+    void onData(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs);
+    void report(std::ostream& os);
+private:
+    typedef std::pair<sctp_assoc_t, uint16_t> StreamKey;
+    // true when the next read on that stream starts a new message
+    std::map<StreamKey, bool> m_atBoundary;
+    std::map<uint32_t, LatencyHistogram> m_latency;
+    uint32_t m_lastTag;
+    uint64_t m_probes;
+};
+
+#endif // PROBE_H
@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <boost/bind.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/make_shared.hpp>
+
+#include "addrinfo.hpp"
+#include "exception.hpp"
+#include "relay.h"
+#include "sctpcat.h"
+#include "util.hpp"
+
+static const char* s_sideName[2] = { "downstream", "upstream" };
+
+Relay::Relay(SctpCat& sc, const boost::program_options::variables_map& options)
+    : m_sc(sc),
+      m_pool(options["relay-buffer"].as<int>(), options["relay-queue"].as<int>()),
+      m_queueLimit(options["relay-queue"].as<int>())
+{
+    int family = options.count("ipv6") ? AF_INET6 : AF_INET;
+    m_upstream = getAi(family, options["upstream-port"].as<std::string>(),
+                       options["upstream-host"].as<std::string>(), false);
+    std::cerr << "Relaying to " << sockaddr2string(m_upstream->ai_addr) << "\n";
+}
+
+Relay::~Relay()
+{
+    while (!m_sessions.empty())
+    {
+        closeSession(m_sessions.begin()->second.first);
+    }
+}
+
+// Aborts an association the relay cannot serve, so that it does not linger
+// on the listening socket
+void Relay::rejectAssociation(int fd, sctp_assoc_t assoc_id)
+{
+    sctp_sndrcvinfo sinfo;
+    memset(&sinfo, 0, sizeof(sinfo));
+    sinfo.sinfo_assoc_id = assoc_id;
+    sinfo.sinfo_flags = SCTP_ABORT;
+    sctp_send(fd, NULL, 0, &sinfo, MSG_NOSIGNAL);
+}
+
+void Relay::onAssociation(int fd, sctp_assoc_t assoc_id)
+{
+    int downstream = sctp_peeloff(fd, assoc_id);
+    if (downstream == -1)
+    {
+        std::cerr << timestamp() << "relay: sctp_peeloff of assoc " << assoc_id << ": " << strerror(errno)
+                  << ", rejecting it\n";
+        rejectAssociation(fd, assoc_id);
+        return;
+    }
+    int flags = fcntl(downstream, F_GETFL, 0);
+    if (flags == -1 || fcntl(downstream, F_SETFL, flags|O_NONBLOCK) == -1)
+    {
+        std::cerr << timestamp() << "relay: fcntl: " << strerror(errno) << ", rejecting assoc " << assoc_id << "\n";
+        rejectAssociation(downstream, 0);
+        close(downstream);
+        return;
+    }
+    int upstream = -1;
+    try
+    {
+        upstream = m_sc.setupSocket(m_upstream->ai_family, NULL, 0);
+    }
+    catch (boost::exception& e)
+    {
+        std::cerr << timestamp() << "relay: upstream socket: " << boost::diagnostic_information(e)
+                  << "relay: rejecting assoc " << assoc_id << "\n";
+        rejectAssociation(downstream, 0);
+        close(downstream);
+        return;
+    }
+    if (connect(upstream, m_upstream->ai_addr, m_upstream->ai_addrlen) == -1 && errno != EINPROGRESS)
+    {
+        int error = errno;
+        close(upstream);
+        rejectAssociation(downstream, 0);
+        close(downstream);
+        std::cerr << timestamp() << "relay: upstream connect failed: " << strerror(error) << "\n";
+        return;
+    }
+
+    SessionPtr s = boost::make_shared<Session>();
+    s->fd[Downstream] = downstream;
+    s->fd[Upstream] = upstream;
+    s->assoc_id[Downstream] = assoc_id;
+    s->assoc_id[Upstream] = 0;
+    s->up[Downstream] = true;
+    s->up[Upstream] = false;
+    for (int side = 0; side < 2; ++side)
+    {
+        s->readDone[side] = false;
+        s->eofSent[side] = false;
+        s->watched[side] = true;
+        s->interest[side] = EPOLLIN;
+        m_sessions[s->fd[side]] = std::make_pair(s, side);
+        m_sc.watchFd(s->fd[side], s->interest[side], boost::bind(&Relay::onEvent, this, _1, _2));
+    }
+    std::cerr << timestamp() << "relay: assoc " << assoc_id << " peeled off to fd " << downstream
+              << ", upstream fd " << upstream << "\n";
+}
+
+void Relay::onEvent(int fd, uint32_t events)
+{
+    boost::unordered_map<int, std::pair<SessionPtr, int> >::iterator it = m_sessions.find(fd);
+    if (it == m_sessions.end())
+    {
+        return;
+    }
+    SessionPtr s = it->second.first;
+    int side = it->second.second;
+    // on HUP/ERR a pending send fails and is dropped instead of waiting for
+    // room that will never come
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+    {
+        flushSide(*s, side);
+    }
+    if ((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !readSide(*s, side))
+    {
+        closeSession(s);
+        return;
+    }
+    flushSide(*s, 1 - side);
+    if (drainShutdown(*s))
+    {
+        closeSession(s);
+        return;
+    }
+    updateInterest(*s);
+}
+
+bool Relay::readSide(Session& s, int side)
+{
+    int other = 1 - side;
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(sctp_sndrcvinfo)) + CMSG_SPACE(sizeof(timespec) * 3)];
+        cmsghdr align;
+    } cmsgbuf;
+    while (!s.readDone[side] && s.queue[other].size() < m_queueLimit)
+    {
+        char* buf = m_pool.get();
+        iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = m_pool.bufferSize();
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsgbuf.buf;
+        msg.msg_controllen = sizeof(cmsgbuf.buf);
+        ssize_t rv = recvmsg(s.fd[side], &msg, 0);
+        if (rv <= 0)
+        {
+            m_pool.put(buf);
+            if (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (rv == 0)
+            {
+                s.readDone[side] = true;
+                return true;
+            }
+            std::cerr << timestamp() << "relay: " << s_sideName[side] << " recvmsg: " << strerror(errno) << "\n";
+            return false;
+        }
+        if (msg.msg_flags & MSG_NOTIFICATION)
+        {
+            bool alive = handleNotification(s, side, buf);
+            m_pool.put(buf);
+            if (!alive)
+            {
+                return false;
+            }
+            continue;
+        }
+        sctp_sndrcvinfo sinfo;
+        memset(&sinfo, 0, sizeof(sinfo));
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == IPPROTO_SCTP && cmsg->cmsg_type == SCTP_SNDRCV)
+            {
+                memcpy(&sinfo, CMSG_DATA(cmsg), sizeof(sinfo));
+            }
+        }
+        uint32_t key = sinfo.sinfo_stream | (sinfo.sinfo_flags & SCTP_UNORDERED ? 0x10000 : 0);
+        Message& m = s.partial[side][key];
+        if (m.chunks.empty())
+        {
+            m.sinfo = sinfo;
+            m.receivedNs = monotonicNs();
+        }
+        Chunk chunk;
+        chunk.data = buf;
+        chunk.len = rv;
+        m.chunks.push_back(chunk);
+        if (msg.msg_flags & MSG_EOR)
+        {
+            s.queue[other].push_back(Message());
+            std::swap(s.queue[other].back(), m);
+            s.partial[side].erase(key);
+        }
+    }
+    return true;
+}
+
+bool Relay::handleNotification(Session& s, int side, const char* buf)
+{
+    const sctp_notification* notify = reinterpret_cast<const sctp_notification*>(buf);
+    if (notify->sn_header.sn_type == SCTP_SHUTDOWN_EVENT)
+    {
+        std::cerr << timestamp() << "relay: " << s_sideName[side] << " shut down, forwarding what it sent\n";
+        s.readDone[side] = true;
+        return true;
+    }
+    if (notify->sn_header.sn_type != SCTP_ASSOC_CHANGE)
+    {
+        return true;
+    }
+    const sctp_assoc_change& change = notify->sn_assoc_change;
+    std::cerr << timestamp() << "relay: " << s_sideName[side] << " assoc " << change.sac_assoc_id
+              << " " << stringize_sctp_sac_state(change.sac_state) << "\n";
+    if (change.sac_state == SCTP_COMM_UP)
+    {
+        s.up[side] = true;
+        s.assoc_id[side] = change.sac_assoc_id;
+        return true;
+    }
+    if (change.sac_state == SCTP_SHUTDOWN_COMP)
+    {
+        // sends to it fail from now on, so its queue drains as drops
+        s.readDone[side] = true;
+        return true;
+    }
+    return change.sac_state == SCTP_RESTART;
+}
+
+// Once everything a shut down side sent has gone out on the other side, the
+// shutdown is passed on. Returns true when both directions are done.
+bool Relay::drainShutdown(Session& s)
+{
+    for (int side = 0; side < 2; ++side)
+    {
+        int other = 1 - side;
+        if (s.readDone[side] && s.queue[other].empty() && s.up[other] && !s.eofSent[other])
+        {
+            sendEof(s, other);
+        }
+    }
+    return s.readDone[Downstream] && s.readDone[Upstream]
+        && s.queue[Downstream].empty() && s.queue[Upstream].empty();
+}
+
+void Relay::sendEof(Session& s, int side)
+{
+    // shutdown(SHUT_WR) only acts on one-to-one style sockets; the upstream
+    // one-to-many socket (and, depending on the kernel, the peeled-off one)
+    // needs SCTP_EOF on the association instead. Whichever does not apply
+    // is a no-op or fails with EINVAL.
+    shutdown(s.fd[side], SHUT_WR);
+    sctp_sndrcvinfo sinfo;
+    memset(&sinfo, 0, sizeof(sinfo));
+    sinfo.sinfo_assoc_id = s.assoc_id[side];
+    sinfo.sinfo_flags = SCTP_EOF;
+    sctp_send(s.fd[side], NULL, 0, &sinfo, MSG_NOSIGNAL);
+    s.eofSent[side] = true;
+    std::cerr << timestamp() << "relay: passing shutdown on to " << s_sideName[side] << "\n";
+}
+
+void Relay::flushSide(Session& s, int side)
+{
+    if (!s.up[side])
+    {
+        return;
+    }
+    DirectionStats& stats = m_stats[side];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(sctp_sndrcvinfo))];
+        cmsghdr align;
+    } cmsgbuf;
+    while (!s.queue[side].empty())
+    {
+        Message& m = s.queue[side].front();
+        m_iov.resize(m.chunks.size());
+        size_t bytes = 0;
+        for (size_t i = 0; i < m.chunks.size(); ++i)
+        {
+            m_iov[i].iov_base = m.chunks[i].data;
+            m_iov[i].iov_len = m.chunks[i].len;
+            bytes += m.chunks[i].len;
+        }
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &m_iov[0];
+        msg.msg_iovlen = m_iov.size();
+        msg.msg_control = cmsgbuf.buf;
+        msg.msg_controllen = sizeof(cmsgbuf.buf);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_SCTP;
+        cmsg->cmsg_type = SCTP_SNDRCV;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(sctp_sndrcvinfo));
+        sctp_sndrcvinfo sinfo;
+        memset(&sinfo, 0, sizeof(sinfo));
+        sinfo.sinfo_stream = m.sinfo.sinfo_stream;
+        sinfo.sinfo_ppid = m.sinfo.sinfo_ppid;
+        sinfo.sinfo_flags = m.sinfo.sinfo_flags & SCTP_UNORDERED;
+        sinfo.sinfo_assoc_id = s.assoc_id[side];
+        memcpy(CMSG_DATA(cmsg), &sinfo, sizeof(sinfo));
+
+        if (sendmsg(s.fd[side], &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return;
+            }
+            ++stats.drops;
+        }
+        else
+        {
+            ++stats.messages;
+            stats.bytes += bytes;
+            stats.added.add(monotonicNs() - m.receivedNs);
+        }
+        releaseMessage(m);
+        s.queue[side].pop_front();
+    }
+}
+
+void Relay::updateInterest(Session& s)
+{
+    for (int side = 0; side < 2; ++side)
+    {
+        uint32_t interest = 0;
+        if (!s.readDone[side] && s.queue[1 - side].size() < m_queueLimit)
+        {
+            interest |= EPOLLIN;
+        }
+        if (s.up[side] && !s.queue[side].empty())
+        {
+            interest |= EPOLLOUT;
+        }
+        if (interest == 0)
+        {
+            if (s.watched[side])
+            {
+                m_sc.unwatchFd(s.fd[side]);
+                s.watched[side] = false;
+            }
+        }
+        else if (!s.watched[side])
+        {
+            m_sc.watchFd(s.fd[side], interest, boost::bind(&Relay::onEvent, this, _1, _2));
+            s.watched[side] = true;
+        }
+        else if (interest != s.interest[side])
+        {
+            m_sc.modifyFd(s.fd[side], interest);
+        }
+        s.interest[side] = interest;
+    }
+}
+
+void Relay::releaseMessage(Message& m)
+{
+    for (size_t i = 0; i < m.chunks.size(); ++i)
+    {
+        m_pool.put(m.chunks[i].data);
+    }
+    m.chunks.clear();
+}
+
+void Relay::closeSession(SessionPtr s)
+{
+    for (int side = 0; side < 2; ++side)
+    {
+        m_stats[side].drops += s->queue[side].size();
+        while (!s->queue[side].empty())
+        {
+            releaseMessage(s->queue[side].front());
+            s->queue[side].pop_front();
+        }
+        m_stats[1 - side].drops += s->partial[side].size();
+        boost::unordered_map<uint32_t, Message>::iterator it;
+        for (it = s->partial[side].begin(); it != s->partial[side].end(); ++it)
+        {
+            releaseMessage(it->second);
+        }
+        m_sessions.erase(s->fd[side]);
+        if (s->watched[side])
+        {
+            m_sc.unwatchFd(s->fd[side]);
+        }
+        // closing starts a graceful SHUTDOWN of that association
+        close(s->fd[side]);
+    }
+    std::cerr << timestamp() << "relay: session for downstream assoc " << s->assoc_id[Downstream] << " closed\n";
+}
+
+void Relay::report(std::ostream& os)
+{
+    for (int side = 0; side < 2; ++side)
+    {
+        const DirectionStats& stats = m_stats[side];
+        os << timestamp() << "relay " << s_sideName[1 - side] << "->" << s_sideName[side] << ": "
+           << stats.messages << " messages, " << stats.bytes << " bytes, " << stats.drops << " dropped\n";
+        if (stats.added.count() > 0)
+        {
+            os << timestamp();
+            stats.added.print(os, std::string("relay added latency ") + s_sideName[1 - side] + "->" + s_sideName[side]);
+        }
+    }
+    os << timestamp() << "relay: " << m_sessions.size() / 2 << " sessions, "
+       << m_pool.allocated() << " buffers of " << m_pool.bufferSize() << " bytes\n";
+}
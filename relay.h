@@ -0,0 +1,104 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <deque>
+#include <iosfwd>
+#include <vector>
+#include <netdb.h>
+#include <netinet/sctp.h>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "bufferpool.h"
+#include "histogram.h"
+
+class SctpCat;
+
+// Relay mode: every association accepted on the listening socket is peeled
+// off into its own descriptor and paired with a new association to the
+// upstream peer. Messages are received into pooled buffers and sent on from
+// the same buffers (scatter/gather for messages that span several), keeping
+// stream, PPID and the unordered flag. When one side cannot keep up, reading
+// from the other side stops until its queue drains. A peer's SHUTDOWN stops
+// reading its side; what it sent is still forwarded, then the shutdown is
+// passed on, and the session ends once both directions are empty.
+class Relay
+{
+public:
+    Relay(SctpCat& sc, const boost::program_options::variables_map& options);
+    ~Relay();
+
+    // association callback for the listening socket
+    void onAssociation(int fd, sctp_assoc_t assoc_id);
+    void report(std::ostream& os);
+private:
+    enum Side { Downstream = 0, Upstream = 1 };
+
+    struct Chunk
+    {
+        char* data;
+        size_t len;
+    };
+
+    struct Message
+    {
+        std::vector<Chunk> chunks;
+        sctp_sndrcvinfo sinfo;
+        uint64_t receivedNs;
+    };
+
+    struct Session
+    {
+        int fd[2];
+        sctp_assoc_t assoc_id[2];
+        bool up[2];
+        // side i has shut down (or ended), nothing more will be read from it
+        bool readDone[2];
+        // the shutdown has been passed on to side i
+        bool eofSent[2];
+        // fd i is in the event loop; sides with nothing to wait for are not,
+        // so a level-triggered HUP cannot spin the loop
+        bool watched[2];
+        uint32_t interest[2];
+        // queue[i] holds messages waiting to be sent on side i
+        std::deque<Message> queue[2];
+        // messages being received on side i, until MSG_EOR, keyed by stream
+        // and unordered flag as interleaved partial deliveries may alternate
+        boost::unordered_map<uint32_t, Message> partial[2];
+    };
+    typedef boost::shared_ptr<Session> SessionPtr;
+
+    struct DirectionStats
+    {
+        DirectionStats() : messages(0), bytes(0), drops(0) {}
+        uint64_t messages;
+        uint64_t bytes;
+        uint64_t drops;
+        // receive on one side -> handed to the kernel on the other
+        LatencyHistogram added;
+    };
+
+    void rejectAssociation(int fd, sctp_assoc_t assoc_id);
+    void onEvent(int fd, uint32_t events);
+    bool readSide(Session& s, int side);
+    void flushSide(Session& s, int side);
+    bool handleNotification(Session& s, int side, const char* buf);
+    bool drainShutdown(Session& s);
+    void sendEof(Session& s, int side);
+    void updateInterest(Session& s);
+    void releaseMessage(Message& m);
+    void closeSession(SessionPtr s);
+
+    SctpCat& m_sc;
+    boost::shared_ptr<addrinfo> m_upstream;
+    BufferPool m_pool;
+    size_t m_queueLimit;
+    std::vector<iovec> m_iov;
+    // fd -> (session, side of that fd)
+    boost::unordered_map<int, std::pair<SessionPtr, int> > m_sessions;
+    // indexed by destination side
+    DirectionStats m_stats[2];
+};
+
+#endif // RELAY_H
@@ -0,0 +1,155 @@
+#include <arpa/inet.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "exception.hpp"
+#include "router.h"
+#include "util.hpp"
+
+size_t hash_value(const Router::RouteKey& key)
+{
+    size_t seed = 0;
+    boost::hash_combine(seed, key.assoc);
+    boost::hash_combine(seed, key.stream);
+    boost::hash_combine(seed, key.ppid);
+    return seed;
+}
+
+static int64_t parseField(const std::string& field)
+{
+    if (field == "*")
+    {
+        return -1;
+    }
+    return boost::lexical_cast<int64_t>(field);
+}
+
+Router::Router(const std::string& ruleFile)
+    : m_unrouted(0)
+{
+    std::ifstream in(ruleFile.c_str());
+    if (!in)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("open", errno) << route_rule_info(ruleFile);
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        line = line.substr(0, line.find_last_not_of(" \t\r") + 1);
+        if (line.find_first_not_of(" \t") != std::string::npos)
+        {
+            addRule(line);
+        }
+    }
+    // the cache holds pointers into m_routes, which is complete by now
+    std::cerr << "Loaded " << m_routes.size() << " routes from " << ruleFile << "\n";
+}
+
+void Router::addRule(const std::string& line)
+{
+    std::istringstream ss(line);
+    std::string assoc, stream, ppid, spec;
+    // the sink takes the rest of the line, pipe commands may contain spaces
+    if (!(ss >> assoc >> stream >> ppid) || !std::getline(ss >> std::ws, spec))
+    {
+        SCTPCAT_THROW(SctpCatError()) << route_rule_info(line);
+    }
+    RouteKey key(0, 0, 0);
+    try
+    {
+        key = RouteKey(parseField(assoc), parseField(stream), parseField(ppid));
+    }
+    catch (boost::bad_lexical_cast&)
+    {
+        SCTPCAT_THROW(SctpCatError()) << route_rule_info(line);
+    }
+    boost::shared_ptr<OutputSink>& sink = m_sinks[spec];
+    if (!sink)
+    {
+        sink = OutputSink::create(spec);
+    }
+    Route route;
+    route.rule = assoc + " " + stream + " " + ppid + " " + spec;
+    route.sink = sink;
+    route.messages = 0;
+    route.bytes = 0;
+    m_assocs.insert(key.assoc);
+    m_streams.insert(key.stream);
+    m_ppids.insert(key.ppid);
+    m_rules[key] = m_routes.size();
+    m_routes.push_back(route);
+}
+
+int64_t Router::known(const boost::unordered_set<int64_t>& values, int64_t value)
+{
+    return values.count(value) ? value : s_any;
+}
+
+Router::Route* Router::lookup(const RouteKey& key)
+{
+    boost::unordered_map<RouteKey, Route*>::const_iterator cached = m_cache.find(key);
+    if (cached != m_cache.end())
+    {
+        return cached->second;
+    }
+    Route* route = NULL;
+    // bit 0 wildcards the association, bit 1 the stream, bit 2 the PPID
+    for (int mask = 0; mask < 8 && !route; ++mask)
+    {
+        RouteKey probe(mask & 1 ? s_any : key.assoc,
+                       mask & 2 ? s_any : key.stream,
+                       mask & 4 ? s_any : key.ppid);
+        boost::unordered_map<RouteKey, size_t>::const_iterator it = m_rules.find(probe);
+        if (it != m_rules.end())
+        {
+            route = &m_routes[it->second];
+        }
+    }
+    m_cache[key] = route;
+    return route;
+}
+
+bool Router::route(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags)
+{
+    Route* route = lookup(RouteKey(known(m_assocs, sinfo.sinfo_assoc_id),
+                                   known(m_streams, sinfo.sinfo_stream),
+                                   known(m_ppids, ntohl(sinfo.sinfo_ppid))));
+    if (!route)
+    {
+        ++m_unrouted;
+        return false;
+    }
+    bool eor = flags & MSG_EOR;
+    uint64_t source = (uint64_t(uint32_t(sinfo.sinfo_assoc_id)) << 16) | sinfo.sinfo_stream;
+    route->sink->write(source, buf, len, eor);
+    route->messages += eor;
+    route->bytes += len;
+    return true;
+}
+
+void Router::flush()
+{
+    std::map<std::string, boost::shared_ptr<OutputSink> >::iterator it;
+    for (it = m_sinks.begin(); it != m_sinks.end(); ++it)
+    {
+        it->second->flush();
+    }
+}
+
+void Router::report(std::ostream& os) const
+{
+    for (size_t i = 0; i < m_routes.size(); ++i)
+    {
+        const Route& r = m_routes[i];
+        os << timestamp() << "route [" << r.rule << "]: " << r.messages << " messages, "
+           << r.bytes << " bytes, sink drops " << r.sink->drops() << "\n";
+    }
+    if (m_unrouted > 0)
+    {
+        os << timestamp() << "unrouted: " << m_unrouted << " reads\n";
+    }
+}
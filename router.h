@@ -0,0 +1,78 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <netinet/sctp.h>
+
+#include "outputsink.h"
+
+// Demultiplexes received data to local sinks by (assoc, stream, PPID).
+//
+// Rule file, one rule per line, '#' starts a comment, '*' matches anything:
+//
+//     # assoc stream ppid sink
+//     *       0      46   file:/var/tmp/diameter.bin
+//     *       *      3    unix:/run/m3ua.sock
+//     *       *      *    discard
+//
+// A rule that pins the PPID beats one that does not, then the stream, then
+// the association. Values no rule names are looked up as '*', which keeps
+// the cache bounded by the rule file however many associations, streams and
+// PPIDs the peer uses. The first lookup of a key walks the eight wildcard
+// combinations; the result is cached.
+class Router
+{
+public:
+    Router(const std::string& ruleFile);
+
+    // Returns false when no rule matched
+    bool route(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags);
+    void flush();
+    void report(std::ostream& os) const;
+private:
+    struct RouteKey
+    {
+        RouteKey(int64_t assoc, int32_t stream, int64_t ppid)
+            : assoc(assoc), stream(stream), ppid(ppid) {}
+        bool operator==(const RouteKey& o) const
+        {
+            return assoc == o.assoc && stream == o.stream && ppid == o.ppid;
+        }
+        int64_t assoc;
+        int32_t stream;
+        int64_t ppid;
+    };
+    friend size_t hash_value(const RouteKey& key);
+    static const int64_t s_any = -1;
+
+    struct Route
+    {
+        std::string rule;
+        boost::shared_ptr<OutputSink> sink;
+        uint64_t messages;
+        uint64_t bytes;
+    };
+
+    void addRule(const std::string& line);
+    static int64_t known(const boost::unordered_set<int64_t>& values, int64_t value);
+    Route* lookup(const RouteKey& key);
+
+    std::vector<Route> m_routes;
+    boost::unordered_map<RouteKey, size_t> m_rules;
+    boost::unordered_map<RouteKey, Route*> m_cache;
+    // values named by some rule, per field
+    boost::unordered_set<int64_t> m_assocs;
+    boost::unordered_set<int64_t> m_streams;
+    boost::unordered_set<int64_t> m_ppids;
+    std::map<std::string, boost::shared_ptr<OutputSink> > m_sinks;
+    uint64_t m_unrouted;
+};
+
+#endif // ROUTER_H
@@ -0,0 +1,773 @@
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "addrinfo.hpp"
+#include "exception.hpp"
+#include "scenario.h"
+#include "sctpcat.h"
+#include "util.hpp"
+
+static const int s_defaultBytes = 64;
+
+ScenarioStep::ScenarioStep()
+    : kind(Sleep), count(0), rateFrom(0), rateTo(0), durationNs(0), bytes(s_defaultBytes), event(CommUp), jump(0)
+{
+}
+
+static uint64_t required(const std::vector<std::string>& fields, size_t i)
+{
+    if (i >= fields.size())
+    {
+        throw boost::bad_lexical_cast();
+    }
+    return boost::lexical_cast<uint64_t>(fields[i]);
+}
+
+static uint64_t optional(const std::vector<std::string>& fields, size_t i, uint64_t fallback)
+{
+    return i < fields.size() ? boost::lexical_cast<uint64_t>(fields[i]) : fallback;
+}
+
+static ScenarioStep::Event parseEvent(const std::string& name)
+{
+    if (name == "COMM_UP")
+    {
+        return ScenarioStep::CommUp;
+    }
+    if (name == "SENDER_DRY")
+    {
+        return ScenarioStep::SenderDry;
+    }
+    if (name == "PEER_ADDR_CHANGE")
+    {
+        return ScenarioStep::PeerAddrChange;
+    }
+    throw boost::bad_lexical_cast();
+}
+
+static ScenarioStep parseStep(const std::string& line)
+{
+    std::istringstream ss(line);
+    std::vector<std::string> f((std::istream_iterator<std::string>(ss)), std::istream_iterator<std::string>());
+    ScenarioStep step;
+    step.text = boost::algorithm::join(f, " ");
+    size_t maxFields = 2;
+    const std::string& verb = f[0];
+    if (verb == "burst")
+    {
+        step.kind = ScenarioStep::Burst;
+        step.count = required(f, 1);
+        step.bytes = optional(f, 2, s_defaultBytes);
+        maxFields = 3;
+    }
+    else if (verb == "ramp")
+    {
+        step.kind = ScenarioStep::Ramp;
+        if (f.size() < 4)
+        {
+            throw boost::bad_lexical_cast();
+        }
+        step.rateFrom = boost::lexical_cast<double>(f[1]);
+        step.rateTo = boost::lexical_cast<double>(f[2]);
+        step.durationNs = uint64_t(boost::lexical_cast<double>(f[3]) * 1e9);
+        step.bytes = optional(f, 4, s_defaultBytes);
+        maxFields = 5;
+    }
+    else if (verb == "sleep")
+    {
+        step.kind = ScenarioStep::Sleep;
+        step.durationNs = required(f, 1) * 1000000ULL;
+    }
+    else if (verb == "wait")
+    {
+        step.kind = ScenarioStep::Wait;
+        if (f.size() < 2)
+        {
+            throw boost::bad_lexical_cast();
+        }
+        step.event = parseEvent(f[1]);
+        step.durationNs = optional(f, 2, 0) * 1000000ULL;
+        maxFields = 3;
+    }
+    else if (verb == "stream")
+    {
+        step.kind = ScenarioStep::Stream;
+        step.count = required(f, 1);
+        if (step.count > 0xffff)
+        {
+            throw boost::bad_lexical_cast();
+        }
+    }
+    else if (verb == "ppid")
+    {
+        step.kind = ScenarioStep::Ppid;
+        step.count = required(f, 1);
+        if (step.count > 0xffffffffULL)
+        {
+            throw boost::bad_lexical_cast();
+        }
+    }
+    else if (verb == "repeat")
+    {
+        step.kind = ScenarioStep::Repeat;
+        step.count = required(f, 1);
+    }
+    else if (verb == "end")
+    {
+        step.kind = ScenarioStep::End;
+        maxFields = 1;
+    }
+    else
+    {
+        throw boost::bad_lexical_cast();
+    }
+    if (f.size() > maxFields || step.bytes <= 0)
+    {
+        throw boost::bad_lexical_cast();
+    }
+    return step;
+}
+
+std::vector<ScenarioStep> parseScenario(const std::string& file)
+{
+    std::ifstream in(file.c_str());
+    if (!in)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("open", errno) << scenario_info(file);
+    }
+    std::vector<ScenarioStep> steps;
+    std::vector<size_t> open;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        try
+        {
+            steps.push_back(parseStep(line));
+        }
+        catch (boost::bad_lexical_cast&)
+        {
+            SCTPCAT_THROW(SctpCatError()) << scenario_info(line);
+        }
+        ScenarioStep& step = steps.back();
+        if (step.kind == ScenarioStep::Repeat)
+        {
+            open.push_back(steps.size() - 1);
+        }
+        else if (step.kind == ScenarioStep::End)
+        {
+            if (open.empty())
+            {
+                SCTPCAT_THROW(SctpCatError()) << scenario_info(line);
+            }
+            step.jump = open.back();
+            steps[open.back()].jump = steps.size() - 1;
+            open.pop_back();
+        }
+    }
+    if (!open.empty())
+    {
+        SCTPCAT_THROW(SctpCatError()) << scenario_info(steps[open.back()].text);
+    }
+    return steps;
+}
+
+// Messages a linear ramp from rateFrom to rateTo should have sent after
+// elapsedNs, and the pause until the next one is due
+static uint64_t rampDue(const ScenarioStep& step, uint64_t elapsedNs)
+{
+    double t = elapsedNs / 1e9;
+    double length = step.durationNs / 1e9;
+    return uint64_t(step.rateFrom * t + (step.rateTo - step.rateFrom) * t * t / (2 * length));
+}
+
+static uint64_t rampGap(const ScenarioStep& step, uint64_t elapsedNs)
+{
+    double rate = step.rateFrom + (step.rateTo - step.rateFrom) * elapsedNs / double(step.durationNs);
+    // sends are batched into slices of at least a millisecond, so that many
+    // fast runs do not turn into one timer expiry per message
+    double gapNs = rate > 0 ? 1e9 / rate : 1e8;
+    gapNs = std::min(std::max(gapNs, 1e6), 1e8);
+    return std::min<uint64_t>(uint64_t(gapNs), step.durationNs - elapsedNs);
+}
+
+// A run's locals live in members: the coroutine is stackless, so nothing on
+// the C++ stack survives a yield
+class Scenario::Run
+{
+public:
+    Run(Scenario& engine, size_t index, int fd);
+
+    void resume();
+    void abort(const std::string& why) { fail(why); }
+    void onReadable();
+    void onWritable();
+    void onTimer();
+    int fd() const { return m_fd; }
+private:
+    const ScenarioStep& step() const { return m_engine.m_steps[m_pc]; }
+    bool sendOne(int bytes);
+    bool eventSeen(ScenarioStep::Event event) const;
+    void handleNotification(const sctp_notification* notify);
+    void sleepFor(uint64_t ns);
+    void waitWritable();
+    bool suspended() const { return m_waitingWrite || m_waitingEvent || m_timerArmed; }
+    void wake();
+    void fail(const std::string& why);
+
+    Scenario& m_engine;
+    size_t m_index;
+    int m_fd;
+    boost::asio::coroutine m_coro;
+    sctp_assoc_t m_assoc_id;
+    bool m_dry;
+    uint64_t m_addrChanges;
+    uint64_t m_addrChangesSeen;
+    bool m_failed;
+    size_t m_pc;
+    uint16_t m_stream;
+    uint32_t m_ppid;
+    uint64_t m_stepSent;
+    uint64_t m_stepStart;
+    std::vector<uint64_t> m_loops;
+    // what the coroutine is suspended on
+    bool m_waitingWrite;
+    bool m_waitingEvent;
+    bool m_timerArmed;
+    TimerQueue::iterator m_timer;
+};
+
+Scenario::Run::Run(Scenario& engine, size_t index, int fd)
+    : m_engine(engine), m_index(index), m_fd(fd), m_assoc_id(0), m_dry(true),
+      m_addrChanges(0), m_addrChangesSeen(0), m_failed(false), m_pc(0), m_stream(0), m_ppid(0),
+      m_stepSent(0), m_stepStart(0), m_loops(engine.m_steps.size(), 0),
+      m_waitingWrite(false), m_waitingEvent(false), m_timerArmed(false)
+{
+}
+
+void Scenario::Run::resume()
+{
+    BOOST_ASIO_CORO_REENTER (m_coro)
+    {
+        while (m_pc < m_engine.m_steps.size() && !m_failed)
+        {
+            m_stepStart = monotonicNs();
+            if (step().kind == ScenarioStep::Repeat)
+            {
+                m_loops[m_pc] = step().count;
+                m_pc = step().count > 0 ? m_pc + 1 : step().jump + 1;
+                continue;
+            }
+            if (step().kind == ScenarioStep::End)
+            {
+                m_pc = --m_loops[step().jump] > 0 ? step().jump + 1 : m_pc + 1;
+                continue;
+            }
+            if (step().kind == ScenarioStep::Stream)
+            {
+                m_stream = step().count;
+            }
+            else if (step().kind == ScenarioStep::Ppid)
+            {
+                m_ppid = step().count;
+            }
+            else if (step().kind == ScenarioStep::Burst)
+            {
+                for (m_stepSent = 0; m_stepSent < step().count && !m_failed; )
+                {
+                    if (!sendOne(step().bytes))
+                    {
+                        waitWritable();
+                        BOOST_ASIO_CORO_YIELD return;
+                    }
+                }
+            }
+            else if (step().kind == ScenarioStep::Ramp)
+            {
+                for (m_stepSent = 0; !m_failed && monotonicNs() - m_stepStart < step().durationNs; )
+                {
+                    if (m_stepSent < rampDue(step(), monotonicNs() - m_stepStart))
+                    {
+                        if (!sendOne(step().bytes))
+                        {
+                            waitWritable();
+                            BOOST_ASIO_CORO_YIELD return;
+                        }
+                        continue;
+                    }
+                    sleepFor(rampGap(step(), monotonicNs() - m_stepStart));
+                    BOOST_ASIO_CORO_YIELD return;
+                }
+            }
+            else if (step().kind == ScenarioStep::Sleep)
+            {
+                sleepFor(step().durationNs);
+                BOOST_ASIO_CORO_YIELD return;
+            }
+            else if (step().kind == ScenarioStep::Wait)
+            {
+                // address changes count from the start of the step, the
+                // other events are states that may already hold
+                m_addrChangesSeen = m_addrChanges;
+                if (!eventSeen(step().event))
+                {
+                    m_waitingEvent = true;
+                    if (step().durationNs > 0)
+                    {
+                        sleepFor(step().durationNs);
+                    }
+                    BOOST_ASIO_CORO_YIELD return;
+                    if (!m_failed && !eventSeen(step().event))
+                    {
+                        ++m_engine.m_timeouts;
+                        if (m_engine.m_verbose)
+                        {
+                            std::cerr << timestamp() << "scenario run " << m_index << ": '" << step().text
+                                      << "' timed out\n";
+                        }
+                    }
+                }
+            }
+            if (m_failed)
+            {
+                break;
+            }
+            m_engine.m_stepTimes[m_pc].add(monotonicNs() - m_stepStart);
+            ++m_pc;
+        }
+        m_engine.runDone(*this);
+    }
+}
+
+bool Scenario::Run::sendOne(int bytes)
+{
+    const char* buf = &m_engine.m_sendBuffer[0];
+    int rv;
+    if (m_assoc_id == 0 && !m_engine.m_oneToOne)
+    {
+        // not up yet: address the peer, the data is queued behind the
+        // pending connect (or sets the association up itself)
+        const addrinfo* peer = m_engine.m_peer.get();
+        sctp_sndrcvinfo sinfo;
+        memset(&sinfo, 0, sizeof(sinfo));
+        sinfo.sinfo_stream = m_stream;
+        sinfo.sinfo_ppid = htonl(m_ppid);
+        rv = sctpSendTo(m_fd, buf, bytes, peer->ai_addr, peer->ai_addrlen, sinfo, MSG_NOSIGNAL);
+    }
+    else
+    {
+        sctp_sndrcvinfo sinfo;
+        memset(&sinfo, 0, sizeof(sinfo));
+        sinfo.sinfo_assoc_id = m_assoc_id;
+        sinfo.sinfo_stream = m_stream;
+        sinfo.sinfo_ppid = htonl(m_ppid);
+        rv = sctp_send(m_fd, buf, bytes, &sinfo, MSG_NOSIGNAL);
+    }
+    if (rv == -1)
+    {
+        // a one-to-one socket is not writable before the connect completes
+        if (errno == EAGAIN || errno == EWOULDBLOCK || (errno == ENOTCONN && m_assoc_id == 0))
+        {
+            return false;
+        }
+        fail(std::string("send: ") + strerror(errno));
+        return true;
+    }
+    ++m_stepSent;
+    ++m_engine.m_sent;
+    m_dry = false;
+    return true;
+}
+
+bool Scenario::Run::eventSeen(ScenarioStep::Event event) const
+{
+    switch (event)
+    {
+        case ScenarioStep::CommUp:
+            return m_assoc_id != 0;
+        case ScenarioStep::SenderDry:
+            return m_dry;
+        case ScenarioStep::PeerAddrChange:
+            return m_addrChanges != m_addrChangesSeen;
+    }
+    return false;
+}
+
+void Scenario::Run::handleNotification(const sctp_notification* notify)
+{
+    switch (notify->sn_header.sn_type)
+    {
+        case SCTP_ASSOC_CHANGE:
+        {
+            const sctp_assoc_change& change = notify->sn_assoc_change;
+            if (change.sac_state == SCTP_COMM_UP || change.sac_state == SCTP_RESTART)
+            {
+                m_assoc_id = change.sac_assoc_id;
+                if (m_engine.m_verbose)
+                {
+                    std::cerr << timestamp() << "scenario run " << m_index << ": assoc " << m_assoc_id << " "
+                              << stringize_sctp_sac_state(change.sac_state) << "\n";
+                }
+            }
+            else
+            {
+                fail(stringize_sctp_sac_state(change.sac_state));
+            }
+            break;
+        }
+        case SCTP_SENDER_DRY_EVENT:
+            m_dry = true;
+            break;
+        case SCTP_PEER_ADDR_CHANGE:
+            ++m_addrChanges;
+            break;
+        case SCTP_SHUTDOWN_EVENT:
+            fail("peer shut down");
+            break;
+    }
+}
+
+void Scenario::Run::onReadable()
+{
+    for (;;)
+    {
+        iovec iov;
+        iov.iov_base = &m_engine.m_recvBuffer[0];
+        iov.iov_len = m_engine.m_recvBuffer.size();
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        ssize_t rv = recvmsg(m_fd, &msg, 0);
+        if (rv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (rv <= 0)
+        {
+            fail(rv == 0 ? std::string("connection closed") : std::string("recvmsg: ") + strerror(errno));
+            break;
+        }
+        if (msg.msg_flags & MSG_NOTIFICATION)
+        {
+            handleNotification(reinterpret_cast<const sctp_notification*>(iov.iov_base));
+        }
+        else if (msg.msg_flags & MSG_EOR)
+        {
+            ++m_engine.m_received;
+        }
+        if (m_failed)
+        {
+            break;
+        }
+    }
+    if ((m_waitingEvent && eventSeen(step().event)) || (m_failed && suspended()))
+    {
+        wake();
+    }
+}
+
+void Scenario::Run::onWritable()
+{
+    if (m_waitingWrite)
+    {
+        wake();
+    }
+}
+
+void Scenario::Run::onTimer()
+{
+    m_timerArmed = false;
+    wake();
+}
+
+void Scenario::Run::sleepFor(uint64_t ns)
+{
+    m_timer = m_engine.schedule(monotonicNs() + ns, this);
+    m_timerArmed = true;
+}
+
+void Scenario::Run::waitWritable()
+{
+    m_waitingWrite = true;
+    m_engine.m_sc.modifyFd(m_fd, EPOLLIN | EPOLLOUT);
+}
+
+void Scenario::Run::wake()
+{
+    if (m_timerArmed)
+    {
+        m_engine.cancel(m_timer);
+        m_timerArmed = false;
+    }
+    if (m_waitingWrite)
+    {
+        m_waitingWrite = false;
+        m_engine.m_sc.modifyFd(m_fd, EPOLLIN);
+    }
+    m_waitingEvent = false;
+    resume();
+}
+
+void Scenario::Run::fail(const std::string& why)
+{
+    if (m_failed)
+    {
+        return;
+    }
+    m_failed = true;
+    ++m_engine.m_failed;
+    std::cerr << timestamp() << "scenario run " << m_index << " failed";
+    if (m_pc < m_engine.m_steps.size())
+    {
+        std::cerr << " in '" << step().text << "'";
+    }
+    std::cerr << ": " << why << "\n";
+}
+
+static void subscribeSenderDry(int fd)
+{
+    sctp_event_subscribe events;
+    socklen_t len = sizeof(events);
+    if (getsockopt(fd, SOL_SCTP, SCTP_EVENTS, &events, &len) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("getsockopt", errno);
+    }
+    events.sctp_sender_dry_event = 1;
+    if (setsockopt(fd, SOL_SCTP, SCTP_EVENTS, &events, len) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+    }
+}
+
+Scenario::Scenario(SctpCat& sc, const boost::program_options::variables_map& options,
+                   const std::string& host, const std::string& port)
+    : m_sc(sc),
+      m_oneToOne(options.count("one-to-one")),
+      m_verbose(!options.count("quiet")),
+      m_steps(parseScenario(options["scenario"].as<std::string>())),
+      m_instances(std::max(options["scenario-instances"].as<int>(), 1)),
+      m_recvBuffer(64 * 1024),
+      m_armedNs(0), m_finished(0), m_failed(0), m_timeouts(0), m_sent(0), m_received(0), m_startNs(0),
+      m_stepTimes(m_steps.size())
+{
+    int family = options.count("ipv6") ? AF_INET6 : AF_INET;
+    m_peer = getAi(family, port, host, false);
+    int bytes = 1;
+    for (size_t i = 0; i < m_steps.size(); ++i)
+    {
+        bytes = std::max(bytes, m_steps[i].bytes);
+    }
+    m_sendBuffer.assign(bytes, 'S');
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("timerfd_create", errno);
+    }
+    m_sc.watchFd(m_timerFd, EPOLLIN, boost::bind(&Scenario::onTimer, this, _1, _2));
+}
+
+Scenario::~Scenario()
+{
+    for (boost::unordered_map<int, Run*>::iterator it = m_byFd.begin(); it != m_byFd.end(); ++it)
+    {
+        m_sc.unwatchFd(it->first);
+        close(it->first);
+    }
+    m_sc.unwatchFd(m_timerFd);
+    close(m_timerFd);
+}
+
+// Every run needs a descriptor; the usual soft limit of 1024 is lifted as
+// far as the hard limit allows
+static void raiseFileLimit(size_t needed)
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur >= needed)
+    {
+        return;
+    }
+    rlim_t wanted = limit.rlim_max == RLIM_INFINITY ? needed : std::min<rlim_t>(needed, limit.rlim_max);
+    if (wanted > limit.rlim_cur)
+    {
+        limit.rlim_cur = wanted;
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1)
+        {
+            std::cerr << timestamp() << "setrlimit(RLIMIT_NOFILE): " << strerror(errno) << "\n";
+            return;
+        }
+    }
+    if (wanted < needed)
+    {
+        std::cerr << timestamp() << "Descriptor limit " << wanted << " is below the " << needed
+                  << " needed, raise the hard limit (ulimit -Hn); runs without a socket fail\n";
+    }
+}
+
+void Scenario::start()
+{
+    std::cerr << timestamp() << "Starting " << m_instances << " scenario runs of " << m_steps.size()
+              << " steps against " << sockaddr2string(m_peer->ai_addr) << "\n";
+    // headroom for stdio, the epoll and timer descriptors and whatever else is open
+    raiseFileLimit(m_instances + 64);
+    for (size_t i = 0; i < m_instances; ++i)
+    {
+        // a run that cannot get going fails on its own, the others still run
+        int fd = -1;
+        std::string error;
+        try
+        {
+            fd = m_sc.setupSocket(m_peer->ai_family, NULL, 0);
+            subscribeSenderDry(fd);
+            if (connect(fd, m_peer->ai_addr, m_peer->ai_addrlen) == -1 && errno != EINPROGRESS)
+            {
+                error = std::string("connect: ") + strerror(errno);
+            }
+        }
+        catch (boost::exception& e)
+        {
+            error = "socket setup: " + boost::diagnostic_information(e);
+        }
+        if (!error.empty() && fd != -1)
+        {
+            close(fd);
+            fd = -1;
+        }
+        RunPtr run(new Run(*this, i, fd));
+        m_runs.push_back(run);
+        if (fd == -1)
+        {
+            run->abort(error);
+            continue;
+        }
+        m_byFd[fd] = run.get();
+        m_sc.watchFd(fd, EPOLLIN, boost::bind(&Scenario::onSocket, this, _1, _2));
+    }
+    m_startNs = monotonicNs();
+    for (size_t i = 0; i < m_runs.size(); ++i)
+    {
+        m_runs[i]->resume();
+    }
+}
+
+void Scenario::onSocket(int fd, uint32_t events)
+{
+    boost::unordered_map<int, Run*>::iterator it = m_byFd.find(fd);
+    if (it != m_byFd.end() && (events & EPOLLOUT))
+    {
+        it->second->onWritable();
+        // the run may have finished and closed its socket
+        it = m_byFd.find(fd);
+    }
+    if (it != m_byFd.end() && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        it->second->onReadable();
+    }
+}
+
+void Scenario::onTimer(int fd, uint32_t)
+{
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("read", errno);
+    }
+    m_armedNs = 0;
+    uint64_t now = monotonicNs();
+    while (!m_timers.empty() && m_timers.begin()->first <= now)
+    {
+        Run* run = m_timers.begin()->second;
+        m_timers.erase(m_timers.begin());
+        run->onTimer();
+    }
+    armTimer();
+}
+
+Scenario::TimerQueue::iterator Scenario::schedule(uint64_t deadlineNs, Run* run)
+{
+    TimerQueue::iterator it = m_timers.insert(std::make_pair(deadlineNs, run));
+    if (m_armedNs == 0 || deadlineNs < m_armedNs)
+    {
+        armTimer();
+    }
+    return it;
+}
+
+void Scenario::cancel(TimerQueue::iterator it)
+{
+    // the timerfd stays armed, an early expiry finds nothing due
+    m_timers.erase(it);
+}
+
+void Scenario::armTimer()
+{
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!m_timers.empty())
+    {
+        m_armedNs = m_timers.begin()->first;
+        spec.it_value.tv_sec = m_armedNs / 1000000000ULL;
+        spec.it_value.tv_nsec = m_armedNs % 1000000000ULL;
+    }
+    else
+    {
+        m_armedNs = 0;
+    }
+    if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("timerfd_settime", errno);
+    }
+}
+
+void Scenario::runDone(Run& run)
+{
+    ++m_finished;
+    if (run.fd() != -1)
+    {
+        m_sc.unwatchFd(run.fd());
+        close(run.fd());
+        m_byFd.erase(run.fd());
+    }
+    if (m_finished < m_runs.size())
+    {
+        return;
+    }
+    std::cerr << timestamp() << "Scenario done after " << (monotonicNs() - m_startNs) / 1000000 << " ms\n";
+    report(std::cerr);
+    m_sc.stop();
+}
+
+void Scenario::report(std::ostream& os)
+{
+    os << timestamp() << "scenario: " << m_finished << "/" << m_runs.size() << " runs done, "
+       << m_failed << " failed, " << m_sent << " messages sent, " << m_received << " received, "
+       << m_timeouts << " wait timeouts\n";
+    for (size_t i = 0; i < m_steps.size(); ++i)
+    {
+        if (m_stepTimes[i].count() > 0)
+        {
+            m_stepTimes[i].print(os, timestamp() + "  step " + boost::lexical_cast<std::string>(i + 1)
+                                     + " '" + m_steps[i].text + "'");
+        }
+    }
+}
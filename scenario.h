@@ -0,0 +1,98 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/sctp.h>
+#include <boost/program_options.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "histogram.h"
+
+class SctpCat;
+
+// One line of a scenario script
+struct ScenarioStep
+{
+    enum Kind { Burst, Ramp, Sleep, Wait, Stream, Ppid, Repeat, End };
+    enum Event { CommUp, SenderDry, PeerAddrChange };
+
+    ScenarioStep();
+
+    Kind kind;
+    std::string text;
+    uint64_t count;      // burst or repeat count, stream or PPID value
+    double rateFrom;     // ramp, messages per second
+    double rateTo;
+    uint64_t durationNs; // ramp length, sleep, wait timeout (0: no timeout)
+    int bytes;
+    Event event;
+    size_t jump;         // repeat: index of its end; end: index of its repeat
+};
+
+// Script format, one step per line, '#' starts a comment:
+//   burst COUNT [BYTES]
+//   ramp FROM TO SECONDS [BYTES]   (messages per second, linear)
+//   sleep MS
+//   wait COMM_UP|SENDER_DRY|PEER_ADDR_CHANGE [TIMEOUT_MS]
+//   stream N
+//   ppid N
+//   repeat N ... end
+std::vector<ScenarioStep> parseScenario(const std::string& file);
+
+// Scenario engine: runs a script against the peer over N associations, one
+// socket each. Every run is a stackless coroutine resumed from the SctpCat
+// event loop when its socket becomes readable or writable or the shared
+// timerfd expires, so thousands of runs cost a socket and a few hundred
+// bytes each rather than a thread. Step durations are collected per step
+// across all runs.
+class Scenario
+{
+public:
+    Scenario(SctpCat& sc, const boost::program_options::variables_map& options,
+             const std::string& host, const std::string& port);
+    ~Scenario();
+
+    void start();
+    void report(std::ostream& os);
+    size_t failed() const { return m_failed; }
+private:
+    class Run;
+    typedef boost::shared_ptr<Run> RunPtr;
+    typedef std::multimap<uint64_t, Run*> TimerQueue;
+
+    void onSocket(int fd, uint32_t events);
+    void onTimer(int fd, uint32_t events);
+    TimerQueue::iterator schedule(uint64_t deadlineNs, Run* run);
+    void cancel(TimerQueue::iterator it);
+    void armTimer();
+    void runDone(Run& run);
+
+    SctpCat& m_sc;
+    boost::shared_ptr<addrinfo> m_peer;
+    bool m_oneToOne;
+    bool m_verbose;
+    std::vector<ScenarioStep> m_steps;
+    size_t m_instances;
+    std::vector<char> m_sendBuffer;
+    std::vector<char> m_recvBuffer;
+    std::vector<RunPtr> m_runs;
+    boost::unordered_map<int, Run*> m_byFd;
+    TimerQueue m_timers;
+    int m_timerFd;
+    uint64_t m_armedNs;
+    size_t m_finished;
+    size_t m_failed;
+    uint64_t m_timeouts;
+    uint64_t m_sent;
+    uint64_t m_received;
+    uint64_t m_startNs;
+    // indexed by step
+    std::vector<LatencyHistogram> m_stepTimes;
+};
+
+#endif // SCENARIO_H
@@ -12,8 +12,10 @@
 #include <netinet/in.h>
 #include <netinet/sctp.h>
 
+
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <boost/algorithm/string.hpp>
@@ -30,6 +32,9 @@
 #include "util.hpp"
 #include "pingthread.h"
 #include "consolethread.h"
+#include "holbench.h"
+#include "relay.h"
+#include "scenario.h"
 
 void disableHb(int fd, sctp_assoc_t assoc_id, const sockaddr_storage& addr, size_t addr_len)
 {
@@ -45,10 +50,72 @@ void disableHb(int fd, sctp_assoc_t assoc_id, const sockaddr_storage& addr, size
     std::cerr << timestamp() << "Disabled HB on " << sockaddr2string(&addr) << "\n";
 }
 
+void sendRequest(ISctpSink& sink, const std::vector<char>& request)
+{
+    sink.send(&request[0], request.size());
+}
+
 SctpCat::SctpCat(const varmap& options)
-    : m_fd(-1), m_options(options)
+    : m_fd(-1), m_acceptor(false), m_sendFd(-1), m_nextWorker(0), m_acceptRetryNs(0), m_assoc_id(0), m_options(options)
 {
     m_printTicks = options.count("ticks");
+    m_quiet = options.count("quiet");
+    m_echo = options.count("echo");
+    m_implicitConnect = options.count("implicit-connect");
+    m_exitOnResponse = options.count("request");
+    m_setupStartNs = 0;
+    m_responseSeen = false;
+    m_stop = false;
+    if (options.count("timestamps"))
+    {
+        m_timestamps = options["timestamps"].as<std::string>();
+    }
+    m_reportInterval = options["report-interval"].as<int>();
+    m_busyPoll = BusyPollOff;
+    if (options.count("busy-poll"))
+    {
+        std::string mode = options["busy-poll"].as<std::string>();
+        if (mode == "epoll")
+        {
+            m_busyPoll = BusyPollEpoll;
+        }
+        else if (mode == "recv")
+        {
+            m_busyPoll = BusyPollRecv;
+        }
+        else
+        {
+            SCTPCAT_THROW(SctpCatError()) << busy_poll_mode_info(mode);
+        }
+    }
+    m_rxTuning = ThreadTuning(options["rx-cpu"].as<std::string>(), options["rt-priority"].as<int>());
+    // SCHED_FIFO workers sharing a CPU with a spinning thread would never run,
+    // so unpinned workers keep the normal policy
+    std::string workerCpus = options["worker-cpus"].as<std::string>();
+    m_workerTuning = ThreadTuning(workerCpus, workerCpus.empty() ? 0 : options["rt-priority"].as<int>());
+    m_loopIdleNs = 0;
+    m_loopWorkNs = 0;
+    m_rxMessages = 0;
+    m_rxBytes = 0;
+    m_echoDrops = 0;
+    m_lastStatsNs = monotonicNs();
+    m_lastStatsBytes = 0;
+    m_oneToOne = options.count("one-to-one");
+    if (options.count("routes"))
+    {
+        m_router = boost::make_shared<Router>(options["routes"].as<std::string>());
+    }
+    if (options.count("shm-export"))
+    {
+        m_shmRing = boost::make_shared<ShmRingWriter>(options["shm-export"].as<std::string>(),
+                                                      size_t(options["shm-size"].as<int>()) << 20,
+                                                      parseShmOverflowPolicy(options["shm-policy"].as<std::string>()));
+    }
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollfd == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_create1", errno);
+    }
     m_aiFamily = options.count("ipv6") ? AF_INET6 : AF_INET;
     m_listen = options.count("listen");
 
@@ -68,10 +135,49 @@ void SctpCat::registerPeerAddressCallback(boost::function<void (int, sctp_assoc_
     m_peerAddresssCallbacks.push_back(cb);
 }
 
+void SctpCat::registerReportCallback(boost::function<void (std::ostream &)> cb)
+{
+    m_reportCallbacks.push_back(cb);
+}
+
+void SctpCat::watchFd(int fd, uint32_t events, FdHandler handler)
+{
+    epoll_event eev;
+    memset(&eev, 0, sizeof(eev));
+    eev.events = events;
+    eev.data.fd = fd;
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &eev) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_ctl", errno);
+    }
+    m_fdHandlers[fd] = handler;
+}
+
+void SctpCat::modifyFd(int fd, uint32_t events)
+{
+    epoll_event eev;
+    memset(&eev, 0, sizeof(eev));
+    eev.events = events;
+    eev.data.fd = fd;
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &eev) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_ctl", errno);
+    }
+}
+
+void SctpCat::unwatchFd(int fd)
+{
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_ctl", errno);
+    }
+    m_fdHandlers.erase(fd);
+}
+
 int SctpCat::setupSocket(int ai_family, sockaddr* local_addr, socklen_t local_addr_len)
 {
     std::cerr << "setup socket for " << ai_family << " " << sockaddr2string(local_addr) << "\n";
-    int fd = socket(ai_family, SOCK_SEQPACKET, IPPROTO_SCTP);
+    int fd = socket(ai_family, m_oneToOne ? SOCK_STREAM : SOCK_SEQPACKET, IPPROTO_SCTP);
     if (fd == -1)
     {
         SCTPCAT_THROW(SctpCatError()) << clib_failure("socket", errno);
@@ -93,6 +199,35 @@ int SctpCat::setupSocket(int ai_family, sockaddr* local_addr, socklen_t local_ad
         }
     }
     subscribeAllEvents(fd);
+    if (m_options.count("interleave"))
+    {
+        enableInterleaving(fd);
+    }
+    if (!m_timestamps.empty())
+    {
+        enableTimestamps(fd);
+    }
+    if (m_options["busy-poll-usecs"].as<int>() > 0)
+    {
+        int usecs = m_options["busy-poll-usecs"].as<int>();
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, socklen_t(sizeof(usecs))) != 0)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+        }
+    }
+    if (m_options.count("stream-scheduler"))
+    {
+        int scheduler = parseStreamScheduler(m_options["stream-scheduler"].as<std::string>());
+        sctp_assoc_value value;
+        memset(&value, 0, sizeof(value));
+        value.assoc_id = SCTP_FUTURE_ASSOC;
+        value.assoc_value = scheduler;
+        if (setsockopt(fd, SOL_SCTP, SCTP_STREAM_SCHEDULER, &value, socklen_t(sizeof(value))) != 0)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+        }
+        std::cerr << "Stream scheduler set to " << streamSchedulerName(scheduler) << "\n";
+    }
     std::cerr << "Socket open, fd=" << fd << "\n";
     return fd;
 }
@@ -103,6 +238,100 @@ void SctpCat::listenSocket()
     {
         SCTPCAT_THROW(SctpCatError()) << clib_failure("listen", errno);
     }
+    m_acceptor = m_oneToOne;
+    int workers = m_options["workers"].as<int>();
+    for (int i = 0; m_acceptor && i < workers; ++i)
+    {
+        int epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_create1", errno);
+        }
+        m_workerEpollFds.push_back(epollfd);
+    }
+}
+
+int SctpCat::acceptConnections()
+{
+    int count = 0;
+    for (;;)
+    {
+        sockaddr_storage from;
+        socklen_t fromlen = sizeof(from);
+        int fd = accept4(m_fd, reinterpret_cast<sockaddr*>(&from), &fromlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return count;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+            {
+                // the pending connections stay queued; runLoop() retries
+                // once the backoff has passed
+                if (m_acceptRetryNs == 0)
+                {
+                    std::cerr << timestamp() << "accept4: " << strerror(errno) << ", backing off\n";
+                }
+                m_acceptRetryNs = monotonicNs() + s_acceptBackoffNs;
+                return count;
+            }
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("accept4", errno);
+        }
+        if (m_acceptRetryNs != 0)
+        {
+            std::cerr << timestamp() << "Accepting again\n";
+            m_acceptRetryNs = 0;
+        }
+        std::cerr << timestamp() << "Accepted " << sockaddr2string(&from) << " on fd " << fd << "\n";
+        ++count;
+        int epollfd = m_epollfd;
+        if (m_workerEpollFds.empty())
+        {
+            m_connections.insert(fd);
+        }
+        else
+        {
+            epollfd = m_workerEpollFds[m_nextWorker++ % m_workerEpollFds.size()];
+        }
+        epoll_event eev;
+        memset(&eev, 0, sizeof(eev));
+        eev.events = EPOLLIN | EPOLLET;
+        eev.data.fd = fd;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &eev) == -1)
+        {
+            std::cerr << timestamp() << "epoll_ctl for fd " << fd << ": " << strerror(errno) << ", dropping it\n";
+            dropConnection(fd);
+        }
+    }
+}
+
+void SctpCat::connectionClosed(int fd)
+{
+    std::cerr << timestamp() << "Connection on fd " << fd << " closed by peer\n";
+    if (fd == m_fd)
+    {
+        m_stop = true;
+        return;
+    }
+    dropConnection(fd);
+}
+
+void SctpCat::dropConnection(int fd)
+{
+    m_connections.erase(fd);
+    // a sender may be using it, the descriptor must not be reused under it
+    ScopedLock lock(m_sendMutex);
+    close(fd);
+    if (fd == m_sendFd)
+    {
+        m_sendFd = -1;
+        m_assoc_id = 0;
+    }
 }
 
 void SctpCat::subscribeAllEvents(int fd)
@@ -126,129 +355,733 @@ void SctpCat::subscribeAllEvents(int fd)
     }
 }
 
-void SctpCat::receiveLoop()
+void SctpCat::enableInterleaving(int fd)
 {
-    int epollfd = epoll_create1(EPOLL_CLOEXEC);
-    if (epollfd == -1)
+    // I-DATA needs full fragment interleave (level 2) to be set first, as the
+    // receiver must be able to tell which stream each partial delivery is for
+    int level = 2;
+    if (setsockopt(fd, SOL_SCTP, SCTP_FRAGMENT_INTERLEAVE, &level, socklen_t(sizeof(level))) != 0)
     {
-        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_create1", errno);
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
     }
-    epoll_event eev;
-    memset(&eev, 0, sizeof(eev));
-    eev.events = EPOLLIN | EPOLLET;
-    eev.data.fd = m_fd;
-    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, m_fd, &eev) == -1)
+    sctp_assoc_value value;
+    memset(&value, 0, sizeof(value));
+    value.assoc_id = SCTP_FUTURE_ASSOC;
+    value.assoc_value = 1;
+    if (setsockopt(fd, SOL_SCTP, SCTP_INTERLEAVING_SUPPORTED, &value, socklen_t(sizeof(value))) != 0)
     {
-        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_ctl", errno);
+        if (errno == EPERM)
+        {
+            // the kernel only offers I-DATA when it is enabled system wide
+            std::cerr << "--interleave needs net.sctp.intl_enable=1 (sysctl -w net.sctp.intl_enable=1)\n";
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno)
+                                          << sysctl_info("net.sctp.intl_enable=1");
+        }
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+    }
+    std::cerr << "User message interleaving enabled\n";
+}
+
+void SctpCat::enableTimestamps(int fd)
+{
+    if (m_timestamps == "ns")
+    {
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, socklen_t(sizeof(on))) != 0)
+        {
+            SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+        }
+    }
+    else
+    {
+        SCTPCAT_THROW(SctpCatError()) << timestamp_mode_info(m_timestamps);
+    }
+    std::cerr << "Kernel receive timestamps enabled (" << m_timestamps << ")\n";
+}
+
+void SctpCat::printStats(std::ostream& os)
+{
+    if (m_dispatchDelay.count() > 0)
+    {
+        os << timestamp();
+        m_dispatchDelay.print(os, "dispatch delay");
+    }
+    uint64_t now = monotonicNs();
+    if (m_rxBytes > 0 && now > m_lastStatsNs)
+    {
+        os << timestamp() << "received " << m_rxMessages << " messages, " << m_rxBytes << " bytes ("
+           << (m_rxBytes - m_lastStatsBytes) * 1000 / (now - m_lastStatsNs) << " MB/s, "
+           << (m_oneToOne ? "one-to-one" : "one-to-many") << ")\n";
+        m_lastStatsNs = now;
+        m_lastStatsBytes = m_rxBytes;
     }
+    if (m_echoDrops > 0)
+    {
+        os << timestamp() << "echo: " << m_echoDrops << " replies dropped, peer not reading\n";
+    }
+    m_probes.report(os);
+    for (size_t i = 0; i < m_reportCallbacks.size(); ++i)
+    {
+        m_reportCallbacks[i](os);
+    }
+    if (m_router)
+    {
+        m_router->report(os);
+    }
+    if (m_shmRing)
+    {
+        m_shmRing->report(os);
+    }
+    uint64_t total = m_loopIdleNs + m_loopWorkNs;
+    if (total > 0)
+    {
+        os << timestamp() << "receive loop: " << (m_busyPoll == BusyPollOff ? "waiting " : "spinning ")
+           << m_loopIdleNs / 1000000 << " ms, working " << m_loopWorkNs / 1000000 << " ms ("
+           << m_loopWorkNs * 100 / total << "% useful)\n";
+    }
+}
+
+void SctpCat::stop()
+{
+    m_stop = true;
+}
+
+void SctpCat::send(const char* buf, size_t len)
+{
+    send(buf, len, 0, 0);
+}
+
+void SctpCat::waitWritable(int fd)
+{
+    pollfd pfd;
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("poll", errno);
+    }
+}
+
+int SctpCat::sendMessage(int fd, const char* buf, size_t len, sctp_sndrcvinfo& sinfo, const addrinfo* to)
+{
+    uint32_t flags = MSG_NOSIGNAL;
+    int rv;
+    // the socket is non-blocking for the receive loop; senders wait for room
     for (;;)
     {
-        epoll_event events[10];
-        int nfds = epoll_wait(epollfd, events, 10, 10000);
-        if (nfds == -1)
+        if (to)
         {
-            SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_wait", errno);
+            rv = sctpSendTo(fd, buf, len, to->ai_addr, to->ai_addrlen, sinfo, flags);
         }
-        ScopedLock lock(m_mutex);
-        for (int i = 0; i < nfds; ++i)
+        else
         {
-            receiveMessages(events[i].data.fd);
+            rv = sctp_send(fd, buf, len, &sinfo, flags);
         }
-        if (m_printTicks)
+        if (rv != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
         {
-            std::cerr << "epoll tick\n";
+            return rv;
         }
+        waitWritable(fd);
     }
 }
 
-void SctpCat::send(const char* buf, size_t len)
+void SctpCat::send(const char* buf, size_t len, uint16_t stream, uint32_t ppid)
 {
-    ScopedLock(m_mutex);
-    if (m_assoc_id == 0)
+    ScopedLock lock(m_sendMutex);
+    // Implicit setup: until COMM_UP, address the peer directly so the kernel
+    // starts the association and bundles the data into COOKIE-ECHO
+    const addrinfo* to = NULL;
+    if (m_assoc_id == 0 || m_sendFd == -1)
     {
-        std::cerr << "send: no association; data discarded (" << len << ") bytes";
-        return;
+        if (!m_implicitConnect || !m_ai)
+        {
+            std::cerr << "send: no association; data discarded (" << len << ") bytes";
+            return;
+        }
+        to = m_ai.get();
+        if (m_setupStartNs == 0)
+        {
+            m_setupStartNs = monotonicNs();
+        }
     }
     sctp_sndrcvinfo sinfo;
     memset(&sinfo, 0, sizeof(sinfo));
     sinfo.sinfo_assoc_id = m_assoc_id;
-    uint32_t flags = MSG_NOSIGNAL;
-    int rv = sctp_send(m_fd, buf, len, &sinfo, flags);
-    //int rv = sctp_sendmsg(m_fd, &buf[0], bytes, m_ai->ai_addr, m_ai->ai_addrlen, 9, flags, 1, 0, 0);
+    sinfo.sinfo_stream = stream;
+    sinfo.sinfo_ppid = htonl(ppid);
+    int fd = to ? m_fd : m_sendFd;
+    int rv = sendMessage(fd, buf, len, sinfo, to);
     if (rv == -1)
     {
-        std::cerr << timestamp() << "sctp_send " << m_fd << " " 
+        std::cerr << timestamp() << "sctp_send " << fd << " " 
             << buf[0] << " " << len << " returned " << rv 
             << ", error is " << strerror(errno) << "\n";
     }
-    else
+    else if (!m_quiet)
     {
         std::cerr << timestamp() << "sent " << rv << " bytes, tsn " << sinfo.sinfo_tsn << "\n";
     }
 }
 
-void SctpCat::receiveMessages(int fd)
+void SctpCat::echo(int fd, const char* buf, size_t len, const sctp_sndrcvinfo& sinfo)
+{
+    sctp_sndrcvinfo reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.sinfo_assoc_id = sinfo.sinfo_assoc_id;
+    reply.sinfo_stream = sinfo.sinfo_stream;
+    reply.sinfo_ppid = sinfo.sinfo_ppid;
+    reply.sinfo_flags = sinfo.sinfo_flags & SCTP_UNORDERED;
+    // runs on the receive loop: a peer that does not read its replies loses
+    // them rather than stalling every other association
+    if (sctp_send(fd, buf, len, &reply, MSG_NOSIGNAL | MSG_DONTWAIT) != -1)
+    {
+        return;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+        ++m_echoDrops;
+    }
+    else
+    {
+        std::cerr << timestamp() << "echo to assoc " << sinfo.sinfo_assoc_id
+                  << " failed: " << strerror(errno) << "\n";
+    }
+}
+
+static uint64_t timespec2ns(const timespec& ts)
+{
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Picks sctp_sndrcvinfo and the kernel receive timestamp out of the control
+// messages
+static void readControlMessages(msghdr& msg, sctp_sndrcvinfo& sinfo, uint64_t& arrivalNs)
+{
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == IPPROTO_SCTP && cmsg->cmsg_type == SCTP_SNDRCV)
+        {
+            memcpy(&sinfo, CMSG_DATA(cmsg), sizeof(sinfo));
+        }
+        else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            arrivalNs = timespec2ns(ts);
+        }
+    }
+}
+
+// Receive pipeline
+//
+// receiveLoop() runs one instantiation of Pipeline, picked from the options
+// at startup. Policy hooks are static and inline, so a configuration that
+// does not need a feature has it compiled out rather than tested for, or
+// called through boost::function, on every message.
+
+// Locking: the verbose configuration shares its state with worker, ping and
+// benchmark threads, the specialized ones only run on the event loop thread
+struct SctpCat::MutexLocking
+{
+    typedef boost::mutex::scoped_lock Lock;
+};
+
+struct SctpCat::NoLocking
+{
+    struct Lock
+    {
+        explicit Lock(boost::mutex&) {}
+    };
+};
+
+static void printReceived(int fd, int len, const sockaddr* from, const sctp_sndrcvinfo& sinfo, int flags)
+{
+    std::cerr << timestamp();
+    std::cerr << "Received " << len << " bytes on fd " << fd << " from " << sockaddr2string(from)
+              << " assoc " << sinfo.sinfo_assoc_id << " stream " << sinfo.sinfo_stream
+              << " tsn " << sinfo.sinfo_tsn
+              << " with flags " << explainRecvmsgFlags(flags) << "\n";
+}
+
+// Logging: what gets printed per message and per idle loop iteration
+struct SctpCat::VerboseLogging
+{
+    static void message(SctpCat& sc, int fd, int len, const sockaddr* from, const sctp_sndrcvinfo& sinfo, int flags)
+    {
+        if (!sc.m_quiet || (flags & MSG_NOTIFICATION))
+        {
+            printReceived(fd, len, from, sinfo, flags);
+        }
+    }
+
+    static void tick(SctpCat& sc)
+    {
+        if (sc.m_printTicks)
+        {
+            std::cerr << "epoll tick\n";
+        }
+    }
+};
+
+struct SctpCat::QuietLogging
+{
+    static void message(SctpCat&, int fd, int len, const sockaddr* from, const sctp_sndrcvinfo& sinfo, int flags)
+    {
+        if (flags & MSG_NOTIFICATION)
+        {
+            printReceived(fd, len, from, sinfo, flags);
+        }
+    }
+
+    static void tick(SctpCat&) {}
+};
+
+// Stats: message counters and probes always; the full variant adds the
+// kernel arrival -> dispatch histogram and receive loop time accounting
+struct SctpCat::CounterStats
+{
+    static uint64_t clock()
+    {
+        return 0;
+    }
+
+    static void onData(SctpCat& sc, const char* buf, int len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs)
+    {
+        // a message larger than the receive buffer takes several reads
+        if (flags & MSG_EOR)
+        {
+            ++sc.m_rxMessages;
+        }
+        sc.m_rxBytes += len;
+        sc.m_probes.onData(buf, len, sinfo, flags, arrivalNs);
+    }
+
+    static void loop(SctpCat&, uint64_t, uint64_t, int) {}
+};
+
+struct SctpCat::FullStats
+{
+    static uint64_t clock()
+    {
+        return monotonicNs();
+    }
+
+    static void onData(SctpCat& sc, const char* buf, int len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs)
+    {
+        if (arrivalNs)
+        {
+            uint64_t now = realtimeNs();
+            sc.m_dispatchDelay.add(now > arrivalNs ? now - arrivalNs : 0);
+        }
+        CounterStats::onData(sc, buf, len, sinfo, flags, arrivalNs);
+    }
+
+    static void loop(SctpCat& sc, uint64_t waitStart, uint64_t workStart, int received)
+    {
+        uint64_t now = monotonicNs();
+        sc.m_loopIdleNs += workStart - waitStart;
+        if (received > 0)
+        {
+            sc.m_loopWorkNs += now - workStart;
+        }
+        else
+        {
+            sc.m_loopIdleNs += now - workStart;
+        }
+    }
+};
+
+// Counters plus the loop time split, without the per-message dispatch delay
+struct SctpCat::TimedStats
+{
+    static uint64_t clock()
+    {
+        return monotonicNs();
+    }
+
+    static void onData(SctpCat& sc, const char* buf, int len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs)
+    {
+        CounterStats::onData(sc, buf, len, sinfo, flags, arrivalNs);
+    }
+
+    static void loop(SctpCat& sc, uint64_t waitStart, uint64_t workStart, int received)
+    {
+        FullStats::loop(sc, waitStart, workStart, received);
+    }
+};
+
+// Output sink: where received data goes
+struct SctpCat::FanOutSink
+{
+    static void deliver(SctpCat& sc, int fd, const char* buf, int len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs)
+    {
+        if (sc.m_router)
+        {
+            sc.m_router->route(buf, len, sinfo, flags);
+        }
+        if (sc.m_shmRing)
+        {
+            sc.m_shmRing->publish(buf, len, sinfo, flags, arrivalNs ? arrivalNs : realtimeNs());
+        }
+        if (sc.m_echo)
+        {
+            sc.echo(fd, buf, len, sinfo);
+        }
+    }
+
+    static void flush(SctpCat& sc)
+    {
+        if (sc.m_router)
+        {
+            sc.m_router->flush();
+        }
+    }
+};
+
+struct SctpCat::DiscardSink
+{
+    static void deliver(SctpCat&, int, const char*, int, const sctp_sndrcvinfo&, int, uint64_t) {}
+    static void flush(SctpCat&) {}
+};
+
+struct SctpCat::ReflectSink
+{
+    static void deliver(SctpCat& sc, int fd, const char* buf, int len, const sctp_sndrcvinfo& sinfo, int, uint64_t)
+    {
+        sc.echo(fd, buf, len, sinfo);
+    }
+
+    static void flush(SctpCat&) {}
+};
+
+// Notification handlers: run the registered callbacks, or nothing beyond
+// the bookkeeping every configuration does
+struct SctpCat::CallbackNotifications
+{
+    static void associationUp(SctpCat& sc, int fd, sctp_assoc_t assoc_id)
+    {
+        for (size_t i = 0; i < sc.m_associationCallbacks.size(); ++i)
+        {
+            sc.m_associationCallbacks[i](fd, assoc_id);
+        }
+    }
+
+    static void peerAddressConfirmed(SctpCat& sc, int fd, const sctp_notification* notify)
+    {
+        for (size_t i = 0; i < sc.m_peerAddresssCallbacks.size(); ++i)
+        {
+            sc.m_peerAddresssCallbacks[i](fd, notify->sn_paddr_change.spc_assoc_id, notify->sn_paddr_change.spc_aaddr);
+        }
+    }
+};
+
+struct SctpCat::CoreNotifications
+{
+    static void associationUp(SctpCat&, int, sctp_assoc_t) {}
+    static void peerAddressConfirmed(SctpCat&, int, const sctp_notification*) {}
+};
+
+template <class LockingPolicy, class LoggingPolicy, class StatsPolicy, class SinkPolicy, class NotificationPolicy>
+struct SctpCat::Pipeline
+{
+    typedef LockingPolicy Locking;
+    typedef LoggingPolicy Logging;
+    typedef StatsPolicy Stats;
+    typedef SinkPolicy Sink;
+    typedef NotificationPolicy Notifications;
+};
+
+void SctpCat::receiveLoop()
+{
+    // Anything beyond a quiet sink or reflector (printing, routing, export,
+    // timestamps, callbacks, extra descriptors, worker threads) needs the
+    // general configuration
+    bool plain = m_quiet && !m_printTicks && !m_router && !m_shmRing && m_timestamps.empty()
+                 && m_associationCallbacks.empty() && m_peerAddresssCallbacks.empty()
+                 && m_fdHandlers.empty() && m_workerEpollFds.empty();
+    // the spinning vs working split is what busy polling is judged by
+    bool timed = m_busyPoll != BusyPollOff || m_reportInterval > 0;
+    if (!plain)
+    {
+        std::cerr << "Receive pipeline: verbose\n";
+        runLoop<VerbosePipeline>();
+    }
+    else if (m_echo && timed)
+    {
+        std::cerr << "Receive pipeline: reflector, timed\n";
+        runLoop<TimedReflectorPipeline>();
+    }
+    else if (m_echo)
+    {
+        std::cerr << "Receive pipeline: reflector\n";
+        runLoop<ReflectorPipeline>();
+    }
+    else if (timed)
+    {
+        std::cerr << "Receive pipeline: quiet sink, timed\n";
+        runLoop<TimedQuietSinkPipeline>();
+    }
+    else
+    {
+        std::cerr << "Receive pipeline: quiet sink\n";
+        runLoop<QuietSinkPipeline>();
+    }
+}
+
+template <class P>
+void SctpCat::runLoop()
+{
+    for (size_t i = 0; i < m_workerEpollFds.size(); ++i)
+    {
+        m_workers.create_thread(boost::bind(&SctpCat::workerLoop<P>, this, m_workerEpollFds[i], i));
+    }
+    m_rxTuning.apply(0);
+    epoll_event eev;
+    memset(&eev, 0, sizeof(eev));
+    eev.events = EPOLLIN | EPOLLET;
+    eev.data.fd = m_fd;
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_fd, &eev) == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_ctl", errno);
+    }
+    uint64_t lastReport = monotonicNs();
+    while (!m_stop)
+    {
+        epoll_event events[10];
+        int nfds = 0;
+        uint64_t waitStart = P::Stats::clock();
+        if (m_busyPoll != BusyPollRecv || m_acceptor || !m_connections.empty() || !m_fdHandlers.empty())
+        {
+            int timeout = m_busyPoll == BusyPollOff ? 10000 : 0;
+            if (m_acceptRetryNs != 0 && timeout != 0)
+            {
+                timeout = s_acceptBackoffNs / 1000000;
+            }
+            nfds = epoll_wait(m_epollfd, events, 10, timeout);
+            if (nfds == -1)
+            {
+                SCTPCAT_THROW(SctpCatError()) << clib_failure("epoll_wait", errno);
+            }
+        }
+        uint64_t workStart = P::Stats::clock();
+        typename P::Locking::Lock lock(m_mutex);
+        int received = 0;
+        if (m_busyPoll == BusyPollRecv && !m_acceptor)
+        {
+            received = receiveMessages<P>(m_fd);
+        }
+        if (m_acceptRetryNs != 0 && monotonicNs() >= m_acceptRetryNs)
+        {
+            received += acceptConnections();
+        }
+        for (int i = 0; i < nfds; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_fd)
+            {
+                received += m_acceptor ? acceptConnections() : receiveMessages<P>(fd);
+                continue;
+            }
+            if (m_connections.count(fd))
+            {
+                received += serveConnection<P>(fd);
+                continue;
+            }
+            boost::unordered_map<int, FdHandler>::iterator it = m_fdHandlers.find(fd);
+            if (it != m_fdHandlers.end())
+            {
+                // the handler may unwatch its own fd, keep a copy alive
+                FdHandler handler = it->second;
+                handler(fd, events[i].events);
+                ++received;
+            }
+        }
+        P::Stats::loop(*this, waitStart, workStart, received);
+        if (m_reportInterval > 0)
+        {
+            uint64_t now = monotonicNs();
+            if (now - lastReport >= uint64_t(m_reportInterval) * 1000000000ULL)
+            {
+                printStats(std::cerr);
+                lastReport = now;
+            }
+        }
+        if (m_busyPoll != BusyPollOff)
+        {
+            continue;
+        }
+        P::Logging::tick(*this);
+    }
+    m_workers.join_all();
+}
+
+// Connections handed to worker threads are served here; the locking policy
+// still serializes message processing, the workers parallelize the waiting
+// and the system calls
+template <class P>
+void SctpCat::workerLoop(int epollfd, size_t index)
 {
+    m_workerTuning.apply(index);
+    while (!m_stop)
+    {
+        epoll_event events[10];
+        int nfds = epoll_wait(epollfd, events, 10, m_busyPoll == BusyPollOff ? 1000 : 0);
+        if (nfds == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // nothing may escape a thread function; stop the whole loop
+            // rather than leave this worker's connections unserved
+            std::cerr << timestamp() << "worker " << index << ": epoll_wait: " << strerror(errno) << "\n";
+            m_stop = true;
+            return;
+        }
+        if (nfds == 0)
+        {
+            continue;
+        }
+        typename P::Locking::Lock lock(m_mutex);
+        for (int i = 0; i < nfds; ++i)
+        {
+            serveConnection<P>(events[i].data.fd);
+        }
+    }
+}
+
+// A connection that fails is logged and dropped on its own, the loop serving
+// it carries on with the others
+template <class P>
+int SctpCat::serveConnection(int fd)
+{
+    try
+    {
+        return receiveMessages<P>(fd);
+    }
+    catch (boost::exception& e)
+    {
+        std::cerr << timestamp() << "Connection on fd " << fd << " failed:\n" << boost::diagnostic_information(e);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << timestamp() << "Connection on fd " << fd << " failed: " << e.what() << "\n";
+    }
+    P::Sink::flush(*this);
+    dropConnection(fd);
+    return 0;
+}
+
+template <class P>
+int SctpCat::receiveMessages(int fd)
+{
+    int count = 0;
     const int msgbufsize = 2000;
     char msgbuf[msgbufsize] = {0};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(sctp_sndrcvinfo)) + CMSG_SPACE(sizeof(timespec))];
+        cmsghdr align;
+    } cmsgbuf;
     sockaddr_storage from;
-    socklen_t fromlen = sizeof(from);
     sockaddr* from_ptr = reinterpret_cast<sockaddr*>(&from);
     sctp_sndrcvinfo sinfo;
-    memset(&sinfo, 0, sizeof(sinfo));
-    int flags = 0;
 
     for (;;)
     {
-        int recvbytes = sctp_recvmsg(fd, msgbuf, msgbufsize, from_ptr, &fromlen, &sinfo, &flags);
+        iovec iov;
+        iov.iov_base = msgbuf;
+        iov.iov_len = msgbufsize;
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        from.ss_family = AF_UNSPEC;
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsgbuf.buf;
+        msg.msg_controllen = sizeof(cmsgbuf.buf);
+        int recvbytes = recvmsg(fd, &msg, 0);
         if (recvbytes == -1)
         {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
-                break;
+                P::Sink::flush(*this);
+                return count;
             }
-            SCTPCAT_THROW(SctpReceiveError()) << clib_failure("sctp_recvmsg", errno);
+            SCTPCAT_THROW(SctpReceiveError()) << clib_failure("recvmsg", errno);
         }
-        //std::cerr << "x " << (int)from_ptr->sa_family << " " << fromlen << "\n";
-        processMessage(fd, msgbuf, recvbytes, from_ptr, fromlen, sinfo, flags);
+        if (recvbytes == 0)
+        {
+            // end of a one-to-one connection
+            P::Sink::flush(*this);
+            connectionClosed(fd);
+            return count;
+        }
+        memset(&sinfo, 0, sizeof(sinfo));
+        uint64_t arrivalNs = 0;
+        readControlMessages(msg, sinfo, arrivalNs);
+        processMessage<P>(fd, msgbuf, recvbytes, from_ptr, msg.msg_namelen, sinfo, msg.msg_flags, arrivalNs);
+        ++count;
     }
 }
 
+template <class P>
 void SctpCat::processMessage(int fd, char* buf, int len, sockaddr* from, socklen_t fromlen,
-                             const sctp_sndrcvinfo& sinfo, int flags)
+                             const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs)
 {
-    std::cerr << timestamp();
-    std::cerr << "Received " << len << " bytes on fd " << fd << " from " << sockaddr2string(from)
-              << " assoc " << sinfo.sinfo_assoc_id << " tsn " << sinfo.sinfo_tsn
-              << " with flags " << explainRecvmsgFlags(flags) << "\n";
+    P::Logging::message(*this, fd, len, from, sinfo, flags);
     if (flags & MSG_NOTIFICATION)
     {
-        sctp_notification* notify = reinterpret_cast<sctp_notification*>(buf);
-        if (notify->sn_header.sn_type == SCTP_ASSOC_CHANGE)
+        processNotification<P>(fd, reinterpret_cast<sctp_notification*>(buf));
+        return;
+    }
+    P::Stats::onData(*this, buf, len, sinfo, flags, arrivalNs);
+    if (m_setupStartNs != 0 && !m_responseSeen)
+    {
+        m_responseSeen = true;
+        std::cerr << timestamp() << "time to first response: "
+                  << (monotonicNs() - m_setupStartNs) / 1000 << " us ("
+                  << (m_implicitConnect ? "implicit" : "explicit") << " setup)\n";
+        if (m_exitOnResponse)
+        {
+            m_stop = true;
+        }
+    }
+    P::Sink::deliver(*this, fd, buf, len, sinfo, flags, arrivalNs);
+}
+
+template <class P>
+void SctpCat::processNotification(int fd, sctp_notification* notify)
+{
+    if (notify->sn_header.sn_type == SCTP_ASSOC_CHANGE)
+    {
+        if (notify->sn_assoc_change.sac_state == SCTP_COMM_UP)
         {
-            if (notify->sn_assoc_change.sac_state == SCTP_COMM_UP)
             {
+                ScopedLock lock(m_sendMutex);
                 m_assoc_id = notify->sn_assoc_change.sac_assoc_id;
-                std::cerr << timestamp() << "COMM_UP on assoc_id " << m_assoc_id << "\n";
-                for (size_t i = 0; i < m_associationCallbacks.size(); ++i)
-                {
-                    m_associationCallbacks[i](fd, m_assoc_id);
-                }
+                m_sendFd = fd;
             }
+            std::cerr << timestamp() << "COMM_UP on assoc_id " << m_assoc_id << "\n";
+            P::Notifications::associationUp(*this, fd, m_assoc_id);
         }
-        if (notify->sn_header.sn_type == SCTP_PEER_ADDR_CHANGE)
+        else if (notify->sn_assoc_change.sac_state == SCTP_COMM_LOST
+                 || notify->sn_assoc_change.sac_state == SCTP_SHUTDOWN_COMP)
         {
-            if (notify->sn_paddr_change.spc_state == SCTP_ADDR_CONFIRMED)
-            {
-                for (size_t i = 0; i < m_peerAddresssCallbacks.size(); ++i)
-                {
-                    m_peerAddresssCallbacks[i](fd, notify->sn_paddr_change.spc_assoc_id, notify->sn_paddr_change.spc_aaddr);
-                }
-            }
+            printStats(std::cerr);
+        }
+    }
+    if (notify->sn_header.sn_type == SCTP_PEER_ADDR_CHANGE)
+    {
+        if (notify->sn_paddr_change.spc_state == SCTP_ADDR_CONFIRMED)
+        {
+            P::Notifications::peerAddressConfirmed(*this, fd, notify);
         }
-        printSctpNotification(std::cerr, notify);
-        std::cerr << "\n";
     }
+    printSctpNotification(std::cerr, notify);
+    std::cerr << "\n";
 }
 
 void SctpCat::setup(std::string host, const std::string &port)
@@ -286,6 +1119,13 @@ void SctpCat::connectSocket(const std::string& host, const std::string &port)
     boost::shared_ptr<addrinfo> ai = getAi(m_aiFamily, port, host, false);
     std::cerr << ai->ai_family << "/" << AF_INET << "/" << AF_INET6 << " "
               << sockaddr2string(ai->ai_addr) << "\n";
+    m_ai = ai;
+    if (m_implicitConnect)
+    {
+        std::cerr << "Implicit association setup; first message goes to " << sockaddr2string(ai->ai_addr) << "\n";
+        return;
+    }
+    m_setupStartNs = monotonicNs();
     if (connect(m_fd, ai->ai_addr, ai->ai_addrlen) == -1)
     {
         switch (errno)
@@ -300,7 +1140,6 @@ void SctpCat::connectSocket(const std::string& host, const std::string &port)
                 SCTPCAT_THROW(SctpCatError()) << clib_failure("connect", errno);
         }
     }
-    m_ai = ai;
 }
 
 void SctpCat::setPathMaxRetrans(sctp_assoc_t assoc_id, int count)
@@ -329,6 +1168,33 @@ void SctpCat::setAssocMaxRetrans(sctp_assoc_t assoc_id, int count)
     std::cerr << "AssociationMaxRetransmissions set to " << count << " on association " << assoc_id << "\n";
 }
 
+void SctpCat::setStreamScheduler(sctp_assoc_t assoc_id, int scheduler)
+{
+    struct sctp_assoc_value value;
+    memset(&value, 0, sizeof(value));
+    value.assoc_id = assoc_id;
+    value.assoc_value = scheduler;
+    if (setsockopt(m_fd, SOL_SCTP, SCTP_STREAM_SCHEDULER, &value, socklen_t(sizeof(value))) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+    }
+    std::cerr << timestamp() << "Stream scheduler set to " << streamSchedulerName(scheduler)
+              << " on association " << assoc_id << "\n";
+}
+
+void SctpCat::setStreamSchedulerValue(sctp_assoc_t assoc_id, uint16_t stream, uint16_t value)
+{
+    struct sctp_stream_value params;
+    memset(&params, 0, sizeof(params));
+    params.assoc_id = assoc_id;
+    params.stream_id = stream;
+    params.stream_value = value;
+    if (setsockopt(m_fd, SOL_SCTP, SCTP_STREAM_SCHEDULER_VALUE, &params, socklen_t(sizeof(params))) != 0)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("setsockopt", errno);
+    }
+}
+
 int main(int argc, char** argv)
 {
     namespace po = boost::program_options;
@@ -336,7 +1202,16 @@ int main(int argc, char** argv)
     desc.add_options()
             ("help,h", "Produce help message")
             ("ticks", po::value<bool>()->zero_tokens(), "Print loop ticks")
-            ("timestamps", "Timestamp received messages and events [todo]")
+            ("timestamps", po::value<std::string>()->implicit_value("ns"),
+             "Kernel receive timestamps: ns (SO_TIMESTAMPNS)")
+            ("rx-cpu", po::value<std::string>()->default_value(""), "Pin the receive thread to this CPU")
+            ("tx-cpus", po::value<std::string>()->default_value(""), "Comma-separated CPUs for sender threads")
+            ("busy-poll", po::value<std::string>()->implicit_value("epoll"),
+             "Spin instead of sleeping: epoll (zero-timeout epoll_wait) or recv (non-blocking receive)")
+            ("busy-poll-usecs", po::value<int>()->default_value(0), "SO_BUSY_POLL value for the socket")
+            ("rt-priority", po::value<int>()->default_value(0), "SCHED_FIFO priority for pinned threads")
+            ("mlock", "Lock all current and future memory (mlockall)")
+            ("report-interval", po::value<int>()->default_value(0), "Print latency statistics every N seconds")
             ("assoc-max-retrans", po::value<int>(), "SCTP Association Max Retransmissions [todo]")
             ("path-max-retrans", po::value<int>(), "SCTP Path Max Retransmissions [todo]")
             ("ipv6,6", "Use IPv6")
@@ -346,7 +1221,35 @@ int main(int argc, char** argv)
             ("ping-bytes", po::value<int>()->default_value(300), "Ping bytes")
             ("ping-interval", po::value<int>(), "Ping interval (ms)")
             ("no-hb-on-secondary", "Disable heartbeats on secondary (multihomed) addresses")
+            ("one-to-one", "Use one-to-one (SOCK_STREAM) sockets; listen mode accepts a descriptor per association")
+            ("workers", po::value<int>()->default_value(0), "Serve accepted one-to-one connections from N worker threads")
+            ("worker-cpus", po::value<std::string>()->default_value(""), "Comma-separated CPUs for worker threads")
+            ("upstream-host", po::value<std::string>(), "Relay accepted associations to this host (listen mode)")
+            ("upstream-port", po::value<std::string>(), "Relay upstream port")
+            ("relay-buffer", po::value<int>()->default_value(64 * 1024), "Relay receive buffer size")
+            ("relay-queue", po::value<int>()->default_value(256), "Relay messages queued per direction before reading stops")
+            ("routes", po::value<std::string>(), "Route received data to local sinks by assoc/stream/PPID (rule file)")
+            ("shm-export", po::value<std::string>(), "Export received messages to a shared memory ring with this name")
+            ("shm-size", po::value<int>()->default_value(64), "Shared memory ring size (MiB, 1-16384)")
+            ("shm-policy", po::value<std::string>()->default_value("block"),
+             "Ring overflow policy: block, drop-oldest or drop-newest")
+            ("echo", "Send every received message back on the same association and stream")
+            ("implicit-connect", "Set the association up with the first message instead of connect()")
+            ("request", "Send one ping-bytes message, report time to first response and exit")
             ("debug", "Debug prints")
+            ("quiet,q", "Do not print every sent/received message")
+            ("stream-scheduler", po::value<std::string>(), "Outbound stream scheduler: fcfs, prio, rr, fc")
+            ("interleave", "Enable user message interleaving (I-DATA)")
+            ("scenario", po::value<std::string>(), "Run the traffic scenario script in this file (connect mode)")
+            ("scenario-instances", po::value<int>()->default_value(1), "Concurrent scenario runs, one association each")
+            ("hol-bench", "Send bulk and probe traffic on separate streams, cycling through stream schedulers")
+            ("hol-schedulers", po::value<std::string>()->default_value("fcfs,prio,rr,fc"), "Schedulers to cycle through in hol-bench")
+            ("hol-duration", po::value<int>()->default_value(10), "Seconds per scheduler in hol-bench")
+            ("bulk-bytes", po::value<int>()->default_value(0), "hol-bench bulk message size (0: a quarter of the send buffer)")
+            ("bulk-stream", po::value<int>()->default_value(0), "hol-bench bulk stream")
+            ("probe-bytes", po::value<int>()->default_value(64), "hol-bench probe message size")
+            ("probe-stream", po::value<int>()->default_value(1), "hol-bench probe stream")
+            ("probe-interval", po::value<int>()->default_value(10), "hol-bench probe interval (ms)")
             ;
     po::positional_options_description pd;
     pd.add("host-port", -1);
@@ -396,6 +1299,15 @@ int main(int argc, char** argv)
         return 2;
     }
 
+    // below 1 MiB a full read is a sizable part of the ring and mostly
+    // dropped; the upper bound keeps the size arithmetic far from overflow
+    const int maxShmSize = 16384;
+    if (vm.count("shm-export") && (vm["shm-size"].as<int>() < 1 || vm["shm-size"].as<int>() > maxShmSize))
+    {
+        std::cerr << "--shm-size must be between 1 and " << maxShmSize << " MiB\n";
+        return 2;
+    }
+
     if (vm.count("debug"))
     {
 #ifdef HAVE_SCTP_MULTIBUF
@@ -407,6 +1319,10 @@ int main(int argc, char** argv)
     }
     try
     {
+        if (vm.count("mlock"))
+        {
+            lockAllMemory();
+        }
         SctpCat sc(vm);
         if (vm.count("listen"))
         {
@@ -423,13 +1339,70 @@ int main(int argc, char** argv)
             {
                 sc.setup("", "");
             }
-            sc.connectSocket(host, port);
+            if (!vm.count("scenario"))
+            {
+                sc.connectSocket(host, port);
+            }
+        }
+        if (vm.count("request"))
+        {
+            std::vector<char> request(vm["ping-bytes"].as<int>(), 'R');
+            if (vm.count("implicit-connect"))
+            {
+                sc.send(&request[0], request.size());
+            }
+            else
+            {
+                sc.registerAssociationCallback(boost::bind(sendRequest, boost::ref(sc), request));
+            }
         }
         boost::shared_ptr<PingThread> ping;
         if (vm.count("ping-interval"))
         {
-            ping = boost::make_shared<PingThread>(boost::ref(sc), vm["ping-bytes"].as<int>(), vm["ping-interval"].as<int>());
-            sc.registerAssociationCallback(boost::bind(&PingThread::start, ping.get()));
+            ThreadTuning tuning(vm["tx-cpus"].as<std::string>(), vm["rt-priority"].as<int>());
+            ping = boost::make_shared<PingThread>(boost::ref(sc), vm["ping-bytes"].as<int>(), vm["ping-interval"].as<int>(), tuning);
+            if (vm.count("implicit-connect"))
+            {
+                ping->start();
+            }
+            else
+            {
+                sc.registerAssociationCallback(boost::bind(&PingThread::start, ping.get()));
+            }
+        }
+        boost::shared_ptr<HolBench> holBench;
+        if (vm.count("hol-bench"))
+        {
+            holBench = boost::make_shared<HolBench>(boost::ref(sc), boost::cref(vm));
+            sc.registerAssociationCallback(boost::bind(&HolBench::start, holBench.get(), _1, _2));
+        }
+        boost::shared_ptr<Scenario> scenario;
+        if (vm.count("scenario"))
+        {
+            if (vm.count("listen"))
+            {
+                std::cerr << "Scenarios run in connect mode\n";
+                return 2;
+            }
+            scenario = boost::make_shared<Scenario>(boost::ref(sc), boost::cref(vm), host, port);
+            sc.registerReportCallback(boost::bind(&Scenario::report, scenario.get(), _1));
+            scenario->start();
+            sc.receiveLoop();
+            return scenario->failed() > 0 ? 1 : 0;
+        }
+        boost::shared_ptr<Relay> relay;
+        if (vm.count("upstream-host"))
+        {
+            if (!vm.count("listen") || !vm.count("upstream-port") || vm.count("one-to-one"))
+            {
+                std::cerr << "Relay mode needs --listen and --upstream-port, and one-to-many sockets\n";
+                return 2;
+            }
+            relay = boost::make_shared<Relay>(boost::ref(sc), boost::cref(vm));
+            sc.registerAssociationCallback(boost::bind(&Relay::onAssociation, relay.get(), _1, _2));
+            sc.registerReportCallback(boost::bind(&Relay::report, relay.get(), _1));
+            sc.receiveLoop();
+            return 0;
         }
         boost::thread console_thread(boost::bind(&consoleThread, boost::ref(sc)));
         sc.receiveLoop();
@@ -1,50 +1,160 @@
 #ifndef SCTPCAT_H
 #define SCTPCAT_H
 #include <boost/program_options.hpp>
+#include <boost/atomic.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <netdb.h>
 #include <netinet/sctp.h>
 #include <string>
 
 #include "isctpsink.h"
+#include "lowlatency.hpp"
+#include "probe.h"
+#include "router.h"
+#include "shmring.h"
 
 class SctpCat : public ISctpSink
 {
 public:
     typedef boost::program_options::variables_map varmap;
+    typedef boost::function<void(int, uint32_t)> FdHandler;
 
     SctpCat(const varmap& options);
     void setup(std::string host, const std::string& port);
     void listenSocket();
     void connectSocket(const std::string &host, const std::string &port);
     void receiveLoop();
+    // makes receiveLoop() return after the current iteration
+    void stop();
+    int setupSocket(int ai_family, sockaddr* local_addr, socklen_t local_addr_len);
     void send(const char* buf, size_t len);
+    void send(const char* buf, size_t len, uint16_t stream, uint32_t ppid);
     void setPathMaxRetrans(sctp_assoc_t assoc_id, int count);
     void setAssocMaxRetrans(sctp_assoc_t assoc_id, int count);
     void setRto(int rtoMin, int rtoMax, int rtoInitial);
+    void setStreamScheduler(sctp_assoc_t assoc_id, int scheduler);
+    void setStreamSchedulerValue(sctp_assoc_t assoc_id, uint16_t stream, uint16_t value);
 
     void registerAssociationCallback(boost::function<void(int, sctp_assoc_t)>);
     void registerPeerAddressCallback(boost::function<void(int, sctp_assoc_t, const sockaddr_storage&)>);
+    void registerReportCallback(boost::function<void(std::ostream&)>);
+
+    // Extra descriptors served by receiveLoop(); handlers get the fd and the
+    // epoll event mask and run with the same locking as message processing
+    void watchFd(int fd, uint32_t events, FdHandler handler);
+    void modifyFd(int fd, uint32_t events);
+    void unwatchFd(int fd);
 private:
     void subscribeAllEvents(int fd);
-    int setupSocket(int ai_family, sockaddr* local_addr, socklen_t local_addr_len);
+    void enableInterleaving(int fd);
+    void waitWritable(int fd);
+    int sendMessage(int fd, const char* buf, size_t len, sctp_sndrcvinfo& sinfo, const addrinfo* to);
+    void echo(int fd, const char* buf, size_t len, const sctp_sndrcvinfo& sinfo);
+
+    int acceptConnections();
+    void connectionClosed(int fd);
+    void dropConnection(int fd);
+
+    void enableTimestamps(int fd);
+    void printStats(std::ostream& os);
+
+    // Receive pipeline policies, defined in sctpcat.cpp
+    struct MutexLocking;
+    struct NoLocking;
+    struct VerboseLogging;
+    struct QuietLogging;
+    struct FullStats;
+    struct CounterStats;
+    struct TimedStats;
+    struct FanOutSink;
+    struct DiscardSink;
+    struct ReflectSink;
+    struct CallbackNotifications;
+    struct CoreNotifications;
+    template <class Locking, class Logging, class Stats, class Sink, class Notifications>
+    struct Pipeline;
+    // the configurations receiveLoop() chooses from
+    typedef Pipeline<MutexLocking, VerboseLogging, FullStats, FanOutSink, CallbackNotifications> VerbosePipeline;
+    typedef Pipeline<NoLocking, QuietLogging, CounterStats, DiscardSink, CoreNotifications> QuietSinkPipeline;
+    typedef Pipeline<NoLocking, QuietLogging, CounterStats, ReflectSink, CoreNotifications> ReflectorPipeline;
+    // the same with receive loop time accounting, for busy polling and --report-interval
+    typedef Pipeline<NoLocking, QuietLogging, TimedStats, DiscardSink, CoreNotifications> TimedQuietSinkPipeline;
+    typedef Pipeline<NoLocking, QuietLogging, TimedStats, ReflectSink, CoreNotifications> TimedReflectorPipeline;
 
-    void receiveMessages(int fd);
-    void processMessage(int fd, char* buf, int len, sockaddr* from, socklen_t fromlen,
-                        const sctp_sndrcvinfo& sinfo, int flags);
+    template <class P> void runLoop();
+    template <class P> void workerLoop(int epollfd, size_t index);
+    template <class P> int serveConnection(int fd);
+    template <class P> int receiveMessages(int fd);
+    template <class P> void processMessage(int fd, char* buf, int len, sockaddr* from, socklen_t fromlen,
+                                           const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs);
+    template <class P> void processNotification(int fd, sctp_notification* notify);
     int m_fd;
+    int m_epollfd;
+    // one-to-one (SOCK_STREAM) style: in listen mode m_fd only accepts and
+    // every association gets its own descriptor
+    bool m_oneToOne;
+    bool m_acceptor;
+    // descriptor of the association send() talks to
+    int m_sendFd;
+    // accepted one-to-one connections served by the event loop itself
+    boost::unordered_set<int> m_connections;
+    std::vector<int> m_workerEpollFds;
+    size_t m_nextWorker;
+    // out of descriptors: accepting is retried at this time, 0 when not backing off
+    uint64_t m_acceptRetryNs;
+    static const uint64_t s_acceptBackoffNs = 100000000ULL;
+    boost::thread_group m_workers;
     sctp_assoc_t m_assoc_id;
     static const int s_maxPendingConnections = 10;
     bool m_printTicks;
+    bool m_quiet;
+    bool m_echo;
+    // client side: no connect(), the first send sets the association up
+    bool m_implicitConnect;
+    bool m_exitOnResponse;
+    boost::atomic<uint64_t> m_setupStartNs;
+    bool m_responseSeen;
+    boost::atomic<bool> m_stop;
+    std::string m_timestamps;
+    int m_reportInterval;
+    enum BusyPoll
+    {
+        BusyPollOff,   // sleep in epoll_wait
+        BusyPollEpoll, // epoll_wait with zero timeout
+        BusyPollRecv   // spin on the non-blocking socket without epoll
+    };
+    BusyPoll m_busyPoll;
+    ThreadTuning m_rxTuning;
+    ThreadTuning m_workerTuning;
+    uint64_t m_loopIdleNs;
+    uint64_t m_loopWorkNs;
+    uint64_t m_rxMessages;
+    uint64_t m_rxBytes;
+    uint64_t m_echoDrops;
+    uint64_t m_lastStatsNs;
+    uint64_t m_lastStatsBytes;
     int m_aiFamily;
     bool m_listen;
     const varmap& m_options;
     boost::shared_ptr<addrinfo> m_ai;
     mutable boost::mutex m_mutex;
+    // guards the send target (m_assoc_id, m_sendFd) for senders on other
+    // threads; separate from m_mutex so a blocked sender does not stall receive
+    mutable boost::mutex m_sendMutex;
     typedef boost::mutex::scoped_lock ScopedLock;
     std::vector< boost::function<void(int, sctp_assoc_t)> > m_associationCallbacks;
     std::vector< boost::function<void(int, sctp_assoc_t, const sockaddr_storage&)> > m_peerAddresssCallbacks;
+    std::vector< boost::function<void(std::ostream&)> > m_reportCallbacks;
+    boost::unordered_map<int, FdHandler> m_fdHandlers;
+    ProbeCollector m_probes;
+    boost::shared_ptr<Router> m_router;
+    boost::shared_ptr<ShmRingWriter> m_shmRing;
+    // kernel socket arrival -> processMessage, only with --timestamps
+    LatencyHistogram m_dispatchDelay;
 };
 
 
@@ -0,0 +1,49 @@
+#include <arpa/inet.h>
+#include <time.h>
+#include <iostream>
+#include <vector>
+#include <boost/exception/diagnostic_information.hpp>
+
+#include "shmring.h"
+
+// Minimal consumer of an sctpcat shared-memory export: prints one line per
+// record, and the producer counters on every idle second.
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << argv[0] << " NAME\n";
+        return 1;
+    }
+    try
+    {
+        ShmRingReader reader(argv[1]);
+        ShmRecord record;
+        std::vector<char> payload;
+        unsigned idle = 0;
+        for (;;)
+        {
+            if (reader.read(record, payload))
+            {
+                idle = 0;
+                std::cout << "assoc " << record.sinfo.sinfo_assoc_id << " stream " << record.sinfo.sinfo_stream
+                          << " ppid " << ntohl(record.sinfo.sinfo_ppid) << " len " << record.length
+                          << ((record.flags & MSG_EOR) ? " eor" : "") << "\n";
+                continue;
+            }
+            timespec pause = { 0, 100000 };
+            nanosleep(&pause, NULL);
+            if (++idle % 10000 == 0)
+            {
+                const ShmRingHeader& h = reader.header();
+                std::cout << "records " << h.messages << " dropped newest " << h.droppedNewest
+                          << " dropped oldest " << h.droppedOldest << " overruns " << reader.overruns() << "\n";
+            }
+        }
+    }
+    catch (boost::exception & e)
+    {
+        std::cerr << boost::diagnostic_information(e);
+        return 2;
+    }
+}
@@ -0,0 +1,335 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <boost/static_assert.hpp>
+
+#include "exception.hpp"
+#include "shmring.h"
+#include "util.hpp"
+
+BOOST_STATIC_ASSERT(sizeof(ShmRingHeader) <= s_shmHeaderSize);
+BOOST_STATIC_ASSERT(sizeof(ShmRecord) <= s_shmAlign);
+
+ShmOverflowPolicy parseShmOverflowPolicy(const std::string& name)
+{
+    if (name == "block") return ShmBlock;
+    if (name == "drop-oldest") return ShmDropOldest;
+    if (name == "drop-newest") return ShmDropNewest;
+    SCTPCAT_THROW(SctpCatError()) << shm_info(name);
+}
+
+const char* shmOverflowPolicyName(uint32_t policy)
+{
+    switch (policy)
+    {
+        case ShmBlock: return "block";
+        case ShmDropOldest: return "drop-oldest";
+        case ShmDropNewest: return "drop-newest";
+        default: return "unknown";
+    }
+}
+
+static void* mapRing(int fd, size_t size, int prot)
+{
+    void* addr = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("mmap", errno);
+    }
+    return addr;
+}
+
+ShmRingWriter::ShmRingWriter(const std::string& name, size_t capacity, ShmOverflowPolicy policy)
+    : m_name(name)
+{
+    size_t rounded = 4096;
+    while (rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+    m_mask = rounded - 1;
+    m_mapSize = s_shmHeaderSize + rounded;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("shm_open", errno);
+    }
+    if (ftruncate(fd, m_mapSize) == -1)
+    {
+        close(fd);
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("ftruncate", errno);
+    }
+    char* base = static_cast<char*>(mapRing(fd, m_mapSize, PROT_READ | PROT_WRITE));
+    close(fd);
+
+    // a fresh object is zero-filled, which is a valid state for every atomic
+    m_header = reinterpret_cast<ShmRingHeader*>(base);
+    m_data = base + s_shmHeaderSize;
+    m_header->capacity = rounded;
+    m_header->policy = policy;
+    m_header->maxConsumers = s_shmMaxConsumers;
+    m_header->version = s_shmRingVersion;
+    boost::atomic_thread_fence(boost::memory_order_release);
+    m_header->magic = s_shmRingMagic;
+    std::cerr << "Exporting received messages to /dev/shm" << (name[0] == '/' ? "" : "/") << name
+              << " (" << rounded << " bytes, " << shmOverflowPolicyName(policy) << ")\n";
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    munmap(m_header, m_mapSize);
+    shm_unlink(m_name.c_str());
+}
+
+void ShmRingWriter::reapDeadConsumers()
+{
+    for (uint32_t i = 0; i < s_shmMaxConsumers; ++i)
+    {
+        ShmConsumerSlot& slot = m_header->consumers[i];
+        if (slot.active.load(boost::memory_order_acquire) == s_shmSlotActive
+            && kill(slot.pid.load(boost::memory_order_relaxed), 0) == -1 && errno == ESRCH)
+        {
+            std::cerr << timestamp() << "shm export: consumer " << slot.pid << " is gone, releasing its slot\n";
+            slot.active.store(s_shmSlotFree, boost::memory_order_release);
+        }
+    }
+}
+
+uint64_t ShmRingWriter::slowestReader()
+{
+    uint64_t slowest = m_header->writePos.load(boost::memory_order_relaxed);
+    for (uint32_t i = 0; i < s_shmMaxConsumers; ++i)
+    {
+        const ShmConsumerSlot& slot = m_header->consumers[i];
+        if (slot.active.load(boost::memory_order_acquire) == s_shmSlotActive)
+        {
+            uint64_t pos = slot.readPos.load(boost::memory_order_acquire);
+            if (pos < slowest)
+            {
+                slowest = pos;
+            }
+        }
+    }
+    return slowest;
+}
+
+// Makes [end - capacity, end) free for writing; false if the message has to be dropped
+bool ShmRingWriter::makeRoom(uint64_t end)
+{
+    uint64_t capacity = m_mask + 1;
+    if (end <= capacity)
+    {
+        return true;
+    }
+    uint64_t limit = end - capacity;
+    if (m_header->policy == ShmDropNewest && slowestReader() < limit)
+    {
+        ++m_header->droppedNewest;
+        return false;
+    }
+    if (m_header->policy == ShmBlock && slowestReader() < limit)
+    {
+        uint64_t start = monotonicNs();
+        for (unsigned spins = 0; slowestReader() < limit; ++spins)
+        {
+            if (spins < 1000)
+            {
+                sched_yield();
+                continue;
+            }
+            timespec pause = { 0, 50000 };
+            nanosleep(&pause, NULL);
+            if (spins % 20000 == 0)
+            {
+                reapDeadConsumers();
+            }
+        }
+        m_header->blockedNs += monotonicNs() - start;
+    }
+    // retire whole records until the space is free
+    uint64_t tail = m_header->tailPos.load(boost::memory_order_relaxed);
+    uint64_t dropped = 0;
+    uint64_t slowest = m_header->policy == ShmDropOldest ? slowestReader() : end;
+    while (tail < limit)
+    {
+        const ShmRecord* old = reinterpret_cast<const ShmRecord*>(m_data + (tail & m_mask));
+        if (old->length != s_shmPadding && tail >= slowest)
+        {
+            ++dropped;
+        }
+        tail += old->size;
+    }
+    m_header->droppedOldest += dropped;
+    m_header->tailPos.store(tail, boost::memory_order_relaxed);
+    // readers must see the new tail before any of the overwriting stores
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    return true;
+}
+
+void ShmRingWriter::publish(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags,
+                            uint64_t arrivalNs)
+{
+    uint64_t capacity = m_mask + 1;
+    uint64_t need = (sizeof(ShmRecord) + len + s_shmAlign - 1) & ~uint64_t(s_shmAlign - 1);
+    if (need > capacity / 2)
+    {
+        ++m_header->droppedNewest;
+        return;
+    }
+    uint64_t pos = m_header->writePos.load(boost::memory_order_relaxed);
+    uint64_t room = capacity - (pos & m_mask);
+    uint64_t padding = room < need ? room : 0;
+    if (!makeRoom(pos + padding + need))
+    {
+        return;
+    }
+    if (padding)
+    {
+        ShmRecord* pad = reinterpret_cast<ShmRecord*>(m_data + (pos & m_mask));
+        pad->size = padding;
+        pad->length = s_shmPadding;
+        pos += padding;
+    }
+    ShmRecord* record = reinterpret_cast<ShmRecord*>(m_data + (pos & m_mask));
+    record->size = need;
+    record->length = len;
+    record->flags = flags;
+    record->reserved = 0;
+    record->arrivalNs = arrivalNs;
+    record->sinfo = sinfo;
+    memcpy(record + 1, buf, len);
+    m_header->writePos.store(pos + need, boost::memory_order_release);
+    m_header->messages.fetch_add(1, boost::memory_order_relaxed);
+    m_header->bytes.fetch_add(len, boost::memory_order_relaxed);
+}
+
+void ShmRingWriter::report(std::ostream& os) const
+{
+    uint32_t consumers = 0;
+    for (uint32_t i = 0; i < s_shmMaxConsumers; ++i)
+    {
+        consumers += m_header->consumers[i].active.load(boost::memory_order_relaxed) == s_shmSlotActive ? 1 : 0;
+    }
+    os << timestamp() << "shm export: " << m_header->messages << " records, " << m_header->bytes
+       << " bytes, " << consumers << " consumers, dropped newest " << m_header->droppedNewest
+       << ", dropped oldest " << m_header->droppedOldest
+       << ", blocked " << m_header->blockedNs / 1000000 << " ms\n";
+}
+
+ShmRingReader::ShmRingReader(const std::string& name)
+    : m_slot(NULL), m_overruns(0)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1)
+    {
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("shm_open", errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || size_t(st.st_size) <= s_shmHeaderSize)
+    {
+        close(fd);
+        SCTPCAT_THROW(SctpCatError()) << clib_failure("fstat", errno);
+    }
+    m_mapSize = st.st_size;
+    // read-write only because the consumer slots live in the header
+    char* base = static_cast<char*>(mapRing(fd, m_mapSize, PROT_READ | PROT_WRITE));
+    close(fd);
+    m_header = reinterpret_cast<ShmRingHeader*>(base);
+    m_data = base + s_shmHeaderSize;
+    if (m_header->magic != s_shmRingMagic || m_header->version != s_shmRingVersion)
+    {
+        munmap(base, m_mapSize);
+        SCTPCAT_THROW(SctpCatError()) << shm_info("bad ring header");
+    }
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    m_mask = m_header->capacity - 1;
+
+    for (uint32_t i = 0; i < m_header->maxConsumers && !m_slot; ++i)
+    {
+        uint32_t expected = s_shmSlotFree;
+        ShmConsumerSlot& slot = m_header->consumers[i];
+        if (slot.active.compare_exchange_strong(expected, s_shmSlotClaiming, boost::memory_order_acq_rel))
+        {
+            m_slot = &slot;
+            m_slot->pid.store(getpid(), boost::memory_order_relaxed);
+            m_slot->readPos.store(m_header->writePos.load(boost::memory_order_acquire),
+                                  boost::memory_order_relaxed);
+            m_slot->active.store(s_shmSlotActive, boost::memory_order_release);
+        }
+    }
+    if (!m_slot)
+    {
+        munmap(base, m_mapSize);
+        SCTPCAT_THROW(SctpCatError()) << shm_info("no free consumer slot");
+    }
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    m_slot->active.store(s_shmSlotFree, boost::memory_order_release);
+    munmap(m_header, m_mapSize);
+}
+
+bool ShmRingReader::read(ShmRecord& record, std::vector<char>& payload)
+{
+    uint64_t pos = m_slot->readPos.load(boost::memory_order_relaxed);
+    for (;;)
+    {
+        uint64_t end = m_header->writePos.load(boost::memory_order_acquire);
+        if (pos >= end)
+        {
+            return false;
+        }
+        uint64_t tail = m_header->tailPos.load(boost::memory_order_acquire);
+        if (pos < tail)
+        {
+            ++m_overruns;
+            pos = tail;
+            continue;
+        }
+        memcpy(&record, m_data + (pos & m_mask), sizeof(record));
+        bool sane = record.size >= sizeof(record) && (pos & m_mask) + record.size <= m_mask + 1
+                    && (record.length == s_shmPadding || record.length <= record.size - sizeof(record));
+        if (!sane)
+        {
+            // torn read of a record that is being overwritten; the producer
+            // has moved tailPos past it before touching the data
+            boost::atomic_thread_fence(boost::memory_order_acquire);
+            uint64_t tail = m_header->tailPos.load(boost::memory_order_relaxed);
+            if (tail <= pos)
+            {
+                return false;
+            }
+            ++m_overruns;
+            pos = tail;
+            continue;
+        }
+        if (record.length != s_shmPadding)
+        {
+            payload.assign(m_data + (pos & m_mask) + sizeof(record),
+                           m_data + (pos & m_mask) + sizeof(record) + record.length);
+        }
+        // the copy is only good if the producer has not started reusing it
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (m_header->tailPos.load(boost::memory_order_relaxed) > pos)
+        {
+            ++m_overruns;
+            continue;
+        }
+        pos += record.size;
+        m_slot->readPos.store(pos, boost::memory_order_release);
+        if (record.length != s_shmPadding)
+        {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <netinet/sctp.h>
+
+// Shared-memory export of received messages (--shm-export NAME).
+//
+// The ring lives in a POSIX shared memory object (/dev/shm/NAME):
+//
+//     ShmRingHeader                      4096 bytes, see below
+//     data                               capacity bytes (power of two)
+//
+// One producer (sctpcat) appends records; any number of consumers, up to
+// maxConsumers, each read every record through their own cursor. Positions
+// are byte counts since the ring was created and never wrap; the offset in
+// the data area is position & (capacity - 1). A record is a ShmRecord
+// followed by the payload, padded to s_shmAlign bytes, and never straddles
+// the end of the data area: a record with length == s_shmPadding fills the
+// rest of the data area instead, and readers skip it. Since every record is
+// aligned, there is always room for that padding header.
+//
+// Publishing: the producer writes the record, then stores writePos with
+// release semantics. Before reusing space it moves tailPos past the records
+// it overwrites. A reader that finds its cursor behind tailPos, or sees
+// tailPos move past the record it has just copied, counts an overrun and
+// resynchronizes at tailPos.
+//
+// Registering: a consumer claims a free slot by moving its state from
+// s_shmSlotFree to s_shmSlotClaiming, stores its pid and readPos, and only
+// then publishes s_shmSlotActive. The producer only counts active slots, so
+// it never takes a half-initialized readPos as the slowest reader.
+//
+// Overflow policy, applied against the slowest registered consumer:
+//   block       - the producer waits; SCTP flow control pushes back on the peer
+//   drop-oldest - old records are overwritten, slow consumers see overruns
+//   drop-newest - the incoming message is discarded
+//
+// Received data is exported as it is read from the socket; a user message
+// larger than sctpcat's receive buffer arrives as several records, the last
+// one with MSG_EOR in flags.
+
+static const uint32_t s_shmRingMagic = 0x53435252; // "SCRR"
+static const uint32_t s_shmRingVersion = 1;
+static const uint32_t s_shmPadding = 0xffffffff;
+static const size_t s_shmHeaderSize = 4096;
+static const size_t s_shmAlign = 64;
+static const uint32_t s_shmMaxConsumers = 32;
+// ShmConsumerSlot::active
+static const uint32_t s_shmSlotFree = 0;
+static const uint32_t s_shmSlotActive = 1;
+static const uint32_t s_shmSlotClaiming = 2;
+
+enum ShmOverflowPolicy
+{
+    ShmBlock = 0,
+    ShmDropOldest = 1,
+    ShmDropNewest = 2
+};
+
+struct ShmRecord
+{
+    uint32_t size;          // whole record including header and padding
+    uint32_t length;        // payload bytes, or s_shmPadding
+    int32_t flags;          // recvmsg() flags, MSG_EOR ends a user message
+    uint32_t reserved;
+    uint64_t arrivalNs;     // kernel arrival (with --timestamps) or read time, CLOCK_REALTIME
+    sctp_sndrcvinfo sinfo;  // sinfo_ppid in network byte order, as received
+};
+
+struct ShmConsumerSlot
+{
+    boost::atomic<uint32_t> active;
+    boost::atomic<int32_t> pid;
+    boost::atomic<uint64_t> readPos;
+    char pad[48];
+};
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t policy;
+    uint32_t maxConsumers;
+    char pad0[40];
+
+    boost::atomic<uint64_t> writePos;
+    char pad1[56];
+    boost::atomic<uint64_t> tailPos;
+    char pad2[56];
+
+    // producer counters
+    boost::atomic<uint64_t> messages;
+    boost::atomic<uint64_t> bytes;
+    boost::atomic<uint64_t> droppedNewest;
+    boost::atomic<uint64_t> droppedOldest;
+    boost::atomic<uint64_t> blockedNs;
+    char pad3[24];
+
+    ShmConsumerSlot consumers[s_shmMaxConsumers];
+};
+
+ShmOverflowPolicy parseShmOverflowPolicy(const std::string& name);
+const char* shmOverflowPolicyName(uint32_t policy);
+
+class ShmRingWriter
+{
+public:
+    ShmRingWriter(const std::string& name, size_t capacity, ShmOverflowPolicy policy);
+    ~ShmRingWriter();
+
+    void publish(const char* buf, size_t len, const sctp_sndrcvinfo& sinfo, int flags, uint64_t arrivalNs);
+    void report(std::ostream& os) const;
+private:
+    ShmRingWriter(const ShmRingWriter&);
+    ShmRingWriter& operator=(const ShmRingWriter&);
+
+    uint64_t slowestReader();
+    bool makeRoom(uint64_t end);
+    void reapDeadConsumers();
+
+    std::string m_name;
+    ShmRingHeader* m_header;
+    char* m_data;
+    uint64_t m_mask;
+    size_t m_mapSize;
+};
+
+// Consumer side; link against sctpcat_shmring
+class ShmRingReader
+{
+public:
+    explicit ShmRingReader(const std::string& name);
+    ~ShmRingReader();
+
+    // Copies the next record out of the ring; false when there is none yet
+    bool read(ShmRecord& record, std::vector<char>& payload);
+
+    uint64_t overruns() const { return m_overruns; }
+    const ShmRingHeader& header() const { return *m_header; }
+private:
+    ShmRingReader(const ShmRingReader&);
+    ShmRingReader& operator=(const ShmRingReader&);
+
+    ShmRingHeader* m_header;
+    const char* m_data;
+    uint64_t m_mask;
+    size_t m_mapSize;
+    ShmConsumerSlot* m_slot;
+    uint64_t m_overruns;
+};
+
+#endif // SHMRING_H
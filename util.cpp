@@ -3,6 +3,8 @@
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sstream>
+#include <string.h>
+#include <time.h>
 #include <boost/preprocessor.hpp>
 
 #include "exception.hpp"
@@ -10,7 +12,7 @@
 
 void timestamp(std::ostream& os)
 {
-    os << "[" << boost::posix_time::second_clock::local_time() << "] ";
+    os << "[" << boost::posix_time::microsec_clock::local_time() << "] ";
 }
 
 std::string timestamp()
@@ -20,6 +22,23 @@ std::string timestamp()
     return ss.str();
 }
 
+static uint64_t clockNs(clockid_t clock)
+{
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t realtimeNs()
+{
+    return clockNs(CLOCK_REALTIME);
+}
+
+uint64_t monotonicNs()
+{
+    return clockNs(CLOCK_MONOTONIC);
+}
+
 std::string sockaddr2string(const sockaddr* addr)
 {
     if (!addr)
@@ -30,6 +49,11 @@ std::string sockaddr2string(const sockaddr* addr)
     std::stringstream ss;
     switch (addr->sa_family)
     {
+        case AF_UNSPEC:
+        {
+            ss << "[unspecified]";
+            break;
+        }
         case AF_INET:
         {
             const sockaddr_in* addr_in = reinterpret_cast<const sockaddr_in*>(addr);
@@ -219,3 +243,55 @@ void printSctpNotification(std::ostream& os, sctp_notification* n)
     dispatchNotification(n, snp);
 }
 
+
+#ifndef SCTP_SS_FC
+#define SCTP_SS_FC (SCTP_SS_RR + 1)
+#endif
+
+int parseStreamScheduler(const std::string& name)
+{
+    if (name == "fcfs") return SCTP_SS_FCFS;
+    if (name == "prio") return SCTP_SS_PRIO;
+    if (name == "rr") return SCTP_SS_RR;
+    if (name == "fc") return SCTP_SS_FC;
+    SCTPCAT_THROW(SctpCatError()) << scheduler_info(name);
+}
+
+const char* streamSchedulerName(int scheduler)
+{
+    switch (scheduler)
+    {
+        case SCTP_SS_FCFS: return "fcfs";
+        case SCTP_SS_PRIO: return "prio";
+        case SCTP_SS_RR: return "rr";
+        case SCTP_SS_FC: return "fc";
+        default: return "unknown";
+    }
+}
+
+int sctpSendTo(int fd, const void* buf, size_t len, const sockaddr* to, socklen_t tolen,
+               const sctp_sndrcvinfo& sinfo, int flags)
+{
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(sctp_sndrcvinfo))];
+        cmsghdr align;
+    } cmsgbuf;
+    iovec iov;
+    iov.iov_base = const_cast<void*>(buf);
+    iov.iov_len = len;
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = const_cast<sockaddr*>(to);
+    msg.msg_namelen = tolen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_SCTP;
+    cmsg->cmsg_type = SCTP_SNDRCV;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(sinfo));
+    memcpy(CMSG_DATA(cmsg), &sinfo, sizeof(sinfo));
+    return sendmsg(fd, &msg, flags);
+}
@@ -1,6 +1,7 @@
 #ifndef SCTPCAT_UTIL_HPP
 #define SCTPCAT_UTIL_HPP
 
+#include <stdint.h>
 #include <sys/socket.h>
 #include <netinet/sctp.h>
 #include <string>
@@ -12,13 +13,25 @@ std::string sockaddr2string(const sockaddr_storage* addr);
 
 std::string explainRecvmsgFlags(int flags);
 
-const char* stringize_sctp_sac_state(sctp_sac_state value);
-const char* stringize_sctp_sn_type(sctp_sn_type value);
+const char* stringize_sctp_sac_state(int value);
+const char* stringize_sctp_sn_type(int value);
 
 void printSctpNotification(std::ostream& os, sctp_notification* n);
 
+// sendmsg() to an explicit peer address with an SCTP_SNDRCV control message.
+// Unlike sctp_sendmsg() it takes send flags, so MSG_NOSIGNAL can be passed.
+int sctpSendTo(int fd, const void* buf, size_t len, const sockaddr* to, socklen_t tolen,
+               const sctp_sndrcvinfo& sinfo, int flags);
+
+// Stream scheduler names as accepted on the command line: fcfs, prio, rr, fc
+int parseStreamScheduler(const std::string& name);
+const char* streamSchedulerName(int scheduler);
+
 std::string timestamp();
 
+uint64_t realtimeNs();
+uint64_t monotonicNs();
+
 void timestamp(std::ostream&);
 
 